@@ -1,5 +1,4 @@
-#include "OneWire_direct_gpio.h"
-#include "OneWire_direct_regtype.h"
+#include "OneWireHal.h"
 
 
 #ifdef ARDUINO_ARCH_ESP32
@@ -23,6 +22,10 @@
 #ifndef MAKITA_H
 #define MAKITA_H
 
+#ifndef IO_REG_TYPE
+#define IO_REG_TYPE OneWireHalRegType
+#endif
+
 #define SWAP_NIBBLES(x) ((x & 0x0F) << 4 | (x & 0xF0) >> 4)
 
 
@@ -42,6 +45,7 @@ template < int m_pin > class Makita {
           set_cell_temperature(20);
           reset_voltages();
           reset_rom();
+          reset_id();
 
           bitmask = PIN_TO_BITMASK(m_pin);
           baseReg = PIN_TO_BASEREG(m_pin);
@@ -56,6 +60,24 @@ template < int m_pin > class Makita {
           memcpy(m_rom,empty_rom,32);
        }
 
+       //resets the ROM ID and the CC DC reply to the same battery's values
+       void reset_id(){
+          uint8_t idbytes[8]={ 0x16,0x07,0x13,0x64,0x14,0x0a,0x0e,0x70};
+          uint8_t dcbytes[16]={ 0x1A, 0x01,0x0A,0x00,0x02,0x03,0x00,0x08,0x24,0x19,0x2A,0x3D,0x05,0x00,0x00,0x00};
+          memcpy(m_id,idbytes,8);
+          memcpy(m_model,dcbytes,16);
+       }
+
+       //sets the 8-byte ROM ID returned by 0x33
+       void set_rom_id(const uint8_t *id){
+          memcpy(m_id,id,8);
+       }
+
+       //sets the 16-byte body of the CC DC reply, model string first
+       void set_model(const uint8_t *body){
+          memcpy(m_model,body,16);
+       }
+
        void reset_voltages(){
          set_cell_voltage(0,4.0f);
          set_cell_voltage(1,4.0f);
@@ -120,10 +142,22 @@ template < int m_pin > class Makita {
  
          for (bitMask = 0x01; bitMask; bitMask <<= 1) {
            for (int tries = 4096; DIRECT_READ(baseReg, bitmask) && tries > 0; tries--) ;
+           uint32_t start = micros();
            // Delay to sample bit value
            delayMicroseconds(20);
-           if (DIRECT_READ(baseReg, bitmask)) r |= bitMask;
-           delayMicroseconds(80);
+           if (DIRECT_READ(baseReg, bitmask)) {
+             r |= bitMask;
+           } else {
+             // A low held far past the slot is the master's reset pulse, not
+             // a bit: drop the byte and let the next reset() answer it
+             while (!DIRECT_READ(baseReg, bitmask) && micros() - start < 1000) ;
+             if (micros() - start >= 300) {
+               m_timestamp = start;
+               r = 0xFF;
+               break;
+             }
+           }
+           while (micros() - start < 100) ;
          }
  
          wire_interrupts();
@@ -229,7 +263,7 @@ template < int m_pin > class Makita {
        }
 
        void set_cell_voltage(uint8_t cell, float value){
-             if(cell>5)return;
+             if(cell>4)return;
              double max_v=0;
              double min_v=0;
 
@@ -237,8 +271,8 @@ template < int m_pin > class Makita {
              pack_voltage=0;
 
              for(int i=0;i<5;i++){
-                max_v=max(cell_voltages[i],max_v);
-                min_v=min(cell_voltages[i],min_v);
+                max_v=cell_voltages[i]>max_v?cell_voltages[i]:max_v;
+                min_v=cell_voltages[i]<min_v?cell_voltages[i]:min_v;
                 pack_voltage+=cell_voltages[i];
              }
 
@@ -261,10 +295,10 @@ template < int m_pin > class Makita {
          if (r == 0x33) {
 
           
-          uint8_t idbytes[] = { 0x16,0x07,0x13,0x64,0x14,0x0a,0x0e,0x69};
-          write((void * ) idbytes, 8);
+          write((void * ) m_id, 8);
 
-          if(read()!=0xF0) return;//only support this command for now
+          r=read();
+          if(r!=0xF0 && r!=0xAA) return false;//only support these commands for now
           read();
           write(m_rom, 32);
           return false;
@@ -281,7 +315,9 @@ template < int m_pin > class Makita {
            }
  
            if (r == 0xDC) {
-            uint8_t dcbytes[17] = { 0x1A, 0x01,0x0A,0x00,0x02,0x03,0x00,0x08,0x24,0x19,0x2A,0x3D,0x05,0x00,0x00,0x00,0x06};
+            uint8_t dcbytes[17];
+            memcpy(dcbytes, m_model, 16);
+            dcbytes[16] = 0x06;
              r = read();
              write(dcbytes, 17);
              return true;
@@ -413,6 +449,14 @@ template < int m_pin > class Makita {
        float cell_temperature=0;
        float voltage_difference=0;
        uint8_t m_rom[32];
+       uint8_t m_id[8];
+       uint8_t m_model[16];
        float cell_voltages[5];
       };
+
+// Prevent this name from leaking into Arduino sketches
+#ifdef IO_REG_TYPE
+#undef IO_REG_TYPE
+#endif
+
 #endif
@@ -1,10 +1,13 @@
-#include "OneWire_direct_gpio.h"
-#include "OneWire_direct_regtype.h"
+#include "OneWireHal.h"
 
 
 #ifndef OneWire_h
 #define OneWire_h
 
+#ifndef IO_REG_TYPE
+#define IO_REG_TYPE OneWireHalRegType
+#endif
+
 #ifdef ARDUINO_ARCH_ESP32
 // due to the dual core esp32, a critical section works better than disabling interrupts
 #  define wire_noInterrupts() {portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;portENTER_CRITICAL(&mux);
@@ -22,13 +25,6 @@
 #include <util/crc16.h>
 #endif
 
-#if ARDUINO >= 100
-#include <Arduino.h>       // for delayMicroseconds, digitalPinToBitMask, etc
-#else
-#include "WProgram.h"      // for delayMicroseconds
-#include "pins_arduino.h"  // for digitalPinToBitMask, etc
-#endif
-
 template < int m_pin > class OneWire
 {
   private:
@@ -167,6 +163,129 @@ void skip()
 
 };
 
+//
+// Resumable transfer engine.
+//
+// A transfer is a list of OneWireOp steps terminated by OW_OP_END. poll()
+// clocks steps out back to back until it reaches an OW_OP_SLEEP_MS step,
+// where it returns OW_BUSY so the caller can service other work; the next
+// poll() resumes after the sleep. Bytes are never split across polls, so
+// the bit and inter-byte timing is the same as the blocking calls above.
+//
+enum {
+    OW_OP_END = 0,
+    OW_OP_RESET,        // reset; the transfer fails if no presence pulse
+    OW_OP_RESET_ANY,    // reset, presence ignored
+    OW_OP_WRITE_BYTE,   // write the literal byte in arg
+    OW_OP_WRITE,        // write arg bytes from the tx stream
+    OW_OP_READ,         // read arg bytes into the rx stream
+    OW_OP_DELAY_US,     // busy wait time microseconds
+    OW_OP_SLEEP_MS      // yield for time milliseconds
+};
+
+enum {
+    OW_IDLE = 0,
+    OW_BUSY,
+    OW_DONE,
+    OW_NO_PRESENCE
+};
+
+struct OneWireOp {
+    uint8_t code;
+    uint8_t arg;        // byte count, or literal byte for OW_OP_WRITE_BYTE
+    uint16_t time;      // gap before each byte (us), delay (us) or sleep (ms)
+};
+
+template < class Bus > class OneWireEngine
+{
+  private:
+    Bus &bus;
+    const OneWireOp *op;
+    const uint8_t *tx;
+    uint8_t *rx;
+    uint8_t state;
+    bool sleeping;
+    uint32_t sleepStart;
+
+  public:
+
+OneWireEngine(Bus &b) : bus(b), op(0), tx(0), rx(0), state(OW_IDLE), sleeping(false), sleepStart(0) {}
+
+void start(const OneWireOp *ops, const uint8_t *txBuf, uint8_t *rxBuf)
+{
+    op = ops;
+    tx = txBuf;
+    rx = rxBuf;
+    sleeping = false;
+    state = OW_BUSY;
+}
+
+uint8_t status() const { return state; }
+
+//
+// Advance the transfer. Returns OW_BUSY while steps remain, otherwise the
+// final status (OW_DONE or OW_NO_PRESENCE).
+//
+uint8_t poll()
+{
+    if (state != OW_BUSY) return state;
+
+    if (sleeping) {
+        if (millis() - sleepStart < op->time) return OW_BUSY;
+        sleeping = false;
+        op++;
+    }
+
+    for (;; op++) {
+        switch (op->code) {
+        case OW_OP_END:
+            state = OW_DONE;
+            return state;
+
+        case OW_OP_RESET:
+            if (!bus.reset()) {
+                state = OW_NO_PRESENCE;
+                return state;
+            }
+            break;
+
+        case OW_OP_RESET_ANY:
+            bus.reset();
+            break;
+
+        case OW_OP_WRITE_BYTE:
+            if (op->time) delayMicroseconds(op->time);
+            bus.write(op->arg);
+            break;
+
+        case OW_OP_WRITE:
+            for (uint8_t i = 0; i < op->arg; i++) {
+                if (op->time) delayMicroseconds(op->time);
+                bus.write(*tx++);
+            }
+            break;
+
+        case OW_OP_READ:
+            for (uint8_t i = 0; i < op->arg; i++) {
+                if (op->time) delayMicroseconds(op->time);
+                *rx++ = bus.read();
+            }
+            break;
+
+        case OW_OP_DELAY_US:
+            delayMicroseconds(op->time);
+            break;
+
+        case OW_OP_SLEEP_MS:
+            sleeping = true;
+            sleepStart = millis();
+            return OW_BUSY;
+        }
+    }
+}
+
+};
+
 // Prevent this name from leaking into Arduino sketches
 #ifdef IO_REG_TYPE
 #undef IO_REG_TYPE
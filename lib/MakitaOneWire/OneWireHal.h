@@ -0,0 +1,35 @@
+#ifndef OneWireHal_h
+#define OneWireHal_h
+
+//
+// Pin and timer HAL for the OneWire master (OneWire2.h) and the Makita
+// slave emulator (Makita.h).
+//
+// Both classes talk to the pin through the DIRECT_* macros and to time
+// through micros()/millis()/delayMicroseconds(). On the target those come
+// from the Arduino core and the register-level GPIO access in
+// OneWire_direct_gpio.h. Build with -DONEWIRE_HOST to get the host
+// implementation instead: a simulated open-drain wire shared between
+// threads, so a master and a slave emulator can talk to each other on a
+// Linux box (see OneWireHalHost.h).
+//
+
+#if defined(ONEWIRE_HOST)
+#include "OneWireHalHost.h"
+#else
+#if ARDUINO >= 100
+#include <Arduino.h>       // for delayMicroseconds, digitalPinToBitMask, etc
+#else
+#include "WProgram.h"      // for delayMicroseconds
+#include "pins_arduino.h"  // for digitalPinToBitMask, etc
+#endif
+#include "OneWire_direct_gpio.h"
+#include "OneWire_direct_regtype.h"
+#endif
+
+// OneWire2.h and Makita.h undefine IO_REG_TYPE at their end so the name
+// doesn't leak into sketches, and redefine it from this when they need it
+// again after the other one has removed it
+typedef IO_REG_TYPE OneWireHalRegType;
+
+#endif // OneWireHal_h
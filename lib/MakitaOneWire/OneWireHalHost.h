@@ -0,0 +1,148 @@
+#ifndef OneWireHalHost_h
+#define OneWireHalHost_h
+
+//
+// Host (Linux) implementation of the OneWire pin/timer HAL.
+//
+// Every pin is an open-drain line with a pull-up. Each thread is one party
+// on the wire (set with simwire_set_party()), with its own output enable
+// and output level per pin; the line reads low if any party drives it low.
+// Run the master on one thread and a Makita<m_pin> emulator on another and
+// they exchange real frames with real microsecond timing.
+//
+// Also provides the small part of the Arduino API the bus and protocol code
+// use (timing, digitalWrite/pinMode, byte, logging).
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define SIMWIRE_PINS            32
+#define SIMWIRE_PARTIES         2
+
+// Cost of one pin read. The slave emulator bounds its edge waits by loop
+// count (sized for an MCU), so reads must not be free on a fast host.
+#ifndef SIMWIRE_READ_NS
+#define SIMWIRE_READ_NS         250
+#endif
+
+// Simulated time runs this many times slower than the host clock, so the
+// scheduler's wake-up latency is small next to a 10 us slot even when both
+// parties share one CPU. All times the code sees are simulated.
+#ifndef SIMWIRE_SLOWDOWN
+#define SIMWIRE_SLOWDOWN        100
+#endif
+
+typedef uint8_t byte;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+
+// ------------------------------------------------------------------
+// Timing
+// ------------------------------------------------------------------
+
+inline std::chrono::steady_clock::time_point simwire_epoch()
+{
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return epoch;
+}
+
+inline uint64_t simwire_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - simwire_epoch()).count() / SIMWIRE_SLOWDOWN;
+}
+
+inline unsigned long micros() { return (unsigned long)(simwire_now_ns() / 1000); }
+inline unsigned long millis() { return (unsigned long)(simwire_now_ns() / 1000000); }
+
+// Wait in short sleeps rather than spinning, so the other party gets the
+// CPU at once even on a single-core host (a yield may hand it back to us)
+inline void simwire_spin_until(uint64_t end)
+{
+    while (simwire_now_ns() < end) std::this_thread::sleep_for(std::chrono::microseconds(1));
+}
+
+inline void delayMicroseconds(unsigned int us)
+{
+    simwire_spin_until(simwire_now_ns() + (uint64_t)us * 1000);
+}
+
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms * SIMWIRE_SLOWDOWN));
+}
+
+inline void yield() { std::this_thread::yield(); }
+
+#define noInterrupts()
+#define interrupts()
+
+#define log_i(fmt, ...) fprintf(stderr, "[I] " fmt "\n", ##__VA_ARGS__)
+#define log_w(fmt, ...) fprintf(stderr, "[W] " fmt "\n", ##__VA_ARGS__)
+#define log_e(fmt, ...) fprintf(stderr, "[E] " fmt "\n", ##__VA_ARGS__)
+#define log_d(fmt, ...) ((void)0)
+
+// ------------------------------------------------------------------
+// Simulated wire
+// ------------------------------------------------------------------
+
+struct SimWirePin {
+    std::atomic<uint8_t> enabled[SIMWIRE_PARTIES];   // output enable
+    std::atomic<uint8_t> level[SIMWIRE_PARTIES];     // output level
+};
+
+inline SimWirePin &simwire_pin(uint32_t pin)
+{
+    static SimWirePin pins[SIMWIRE_PINS];
+    return pins[pin % SIMWIRE_PINS];
+}
+
+inline int &simwire_party()
+{
+    static thread_local int party = 0;
+    return party;
+}
+
+// Party 0 is the master (default for every thread), 1 the slave
+inline void simwire_set_party(int party) { simwire_party() = party % SIMWIRE_PARTIES; }
+
+inline uint32_t simwire_read(uint32_t pin)
+{
+    simwire_spin_until(simwire_now_ns() + SIMWIRE_READ_NS);
+
+    SimWirePin &p = simwire_pin(pin);
+    for (int i = 0; i < SIMWIRE_PARTIES; i++) {
+        if (p.enabled[i].load() && !p.level[i].load()) return 0;
+    }
+    return 1;   // pull-up
+}
+
+inline void simwire_level(uint32_t pin, uint8_t v) { simwire_pin(pin).level[simwire_party()].store(v); }
+inline void simwire_enable(uint32_t pin, uint8_t v) { simwire_pin(pin).enabled[simwire_party()].store(v); }
+
+#define PIN_TO_BASEREG(pin)             ((volatile uint32_t *)0)
+#define PIN_TO_BITMASK(pin)             (pin)
+#define IO_REG_TYPE                     uint32_t
+#define IO_REG_BASE_ATTR
+#define IO_REG_MASK_ATTR
+#define DIRECT_READ(base, pin)          simwire_read(pin)
+#define DIRECT_WRITE_LOW(base, pin)     simwire_level(pin, 0)
+#define DIRECT_WRITE_HIGH(base, pin)    simwire_level(pin, 1)
+#define DIRECT_MODE_INPUT(base, pin)    simwire_enable(pin, 0)
+#define DIRECT_MODE_OUTPUT(base, pin)   simwire_enable(pin, 1)
+
+inline int digitalRead(uint8_t pin) { return simwire_read(pin); }
+inline void digitalWrite(uint8_t pin, uint8_t v) { simwire_level(pin, v); }
+inline void pinMode(uint8_t pin, uint8_t mode) { simwire_enable(pin, mode == OUTPUT); }
+
+#endif // OneWireHalHost_h
@@ -0,0 +1,178 @@
+#ifndef OneWireRMT_h
+#define OneWireRMT_h
+
+//
+// OneWire master on the ESP32 RMT peripheral.
+//
+// Drop-in alternative to OneWire<m_pin> (OneWire2.h): whole bytes are
+// encoded as RMT symbols and clocked out by hardware, and read slots are
+// decoded from an RX capture on the same open-drain pin. The slot timing
+// no longer depends on the CPU, so WiFi interrupts cannot stretch a bit,
+// and the task sleeps while a byte is on the wire.
+//
+// Select it with -DONEWIRE_RMT=1. Uses the IDF 4.x RMT driver; on the
+// ESP32-C3 channels 0-1 are TX only and 2-3 RX only.
+//
+
+#include <Arduino.h>
+#include <driver/rmt.h>
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
+#include <soc/io_mux_reg.h>
+#include "OneWireRMTCodec.h"
+
+#ifndef ONEWIRE_RMT_TX_CHANNEL
+#define ONEWIRE_RMT_TX_CHANNEL RMT_CHANNEL_0
+#endif
+
+#ifndef ONEWIRE_RMT_RX_CHANNEL
+#define ONEWIRE_RMT_RX_CHANNEL RMT_CHANNEL_2
+#endif
+
+#define OW_RMT_RX_BUFFER        512
+#define OW_RMT_RX_TIMEOUT_MS    10
+#define OW_RMT_MAX_SYMBOLS      48      // one memory block per channel
+
+static_assert(sizeof(OneWireSymbol) == sizeof(rmt_item32_t), "RMT symbol layout");
+
+template < int m_pin > class OneWireRMT
+{
+  private:
+    RingbufHandle_t rxRing = nullptr;
+    bool ready = false;
+
+void begin()
+{
+    rmt_config_t tx = RMT_DEFAULT_CONFIG_TX((gpio_num_t)m_pin, (rmt_channel_t)ONEWIRE_RMT_TX_CHANNEL);
+    tx.clk_div = 80;                            // 1 us per tick
+    tx.tx_config.idle_level = RMT_IDLE_LEVEL_HIGH;
+    tx.tx_config.idle_output_en = true;
+    rmt_config(&tx);
+    rmt_driver_install((rmt_channel_t)ONEWIRE_RMT_TX_CHANNEL, 0, 0);
+
+    rmt_config_t rx = RMT_DEFAULT_CONFIG_RX((gpio_num_t)m_pin, (rmt_channel_t)ONEWIRE_RMT_RX_CHANNEL);
+    rx.clk_div = 80;
+    rx.rx_config.filter_en = true;
+    rx.rx_config.filter_ticks_thresh = 100;    // ~1.25 us glitch filter
+    rx.rx_config.idle_threshold = OW_RMT_RX_IDLE_US;
+    rmt_config(&rx);
+    rmt_driver_install((rmt_channel_t)ONEWIRE_RMT_RX_CHANNEL, OW_RMT_RX_BUFFER, 0);
+    rmt_get_ringbuf_handle((rmt_channel_t)ONEWIRE_RMT_RX_CHANNEL, &rxRing);
+
+    // Route both channels to the one pin. RX first: configuring the TX
+    // side last keeps its signal in the GPIO matrix.
+    rmt_set_gpio((rmt_channel_t)ONEWIRE_RMT_RX_CHANNEL, RMT_MODE_RX, (gpio_num_t)m_pin, false);
+    rmt_set_gpio((rmt_channel_t)ONEWIRE_RMT_TX_CHANNEL, RMT_MODE_TX, (gpio_num_t)m_pin, false);
+
+    // Keep the input path enabled and drive open-drain, so the pull-up and
+    // the battery can both pull the line while we transmit.
+    PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[m_pin]);
+    GPIO.pin[m_pin].pad_driver = 1;
+
+    ready = true;
+}
+
+void flushRx()
+{
+    size_t size;
+    void *item;
+    while ((item = xRingbufferReceive(rxRing, &size, 0)) != nullptr) {
+        vRingbufferReturnItem(rxRing, item);
+    }
+}
+
+void transmit(const OneWireSymbol *symbols, size_t n)
+{
+    if (!ready) begin();
+    rmt_write_items((rmt_channel_t)ONEWIRE_RMT_TX_CHANNEL,
+                    (const rmt_item32_t *)symbols, n, true);
+}
+
+// Transmit while capturing the line. Returns the number of captured
+// symbols, 0 if nothing was seen before the timeout.
+size_t transfer(const OneWireSymbol *symbols, size_t n, OneWireSymbol *capture, size_t max)
+{
+    if (!ready) begin();
+
+    flushRx();
+    rmt_rx_start((rmt_channel_t)ONEWIRE_RMT_RX_CHANNEL, true);
+    transmit(symbols, n);
+
+    size_t size = 0;
+    OneWireSymbol *items = (OneWireSymbol *)xRingbufferReceive(rxRing, &size, pdMS_TO_TICKS(OW_RMT_RX_TIMEOUT_MS));
+    rmt_rx_stop((rmt_channel_t)ONEWIRE_RMT_RX_CHANNEL);
+
+    if (!items) return 0;
+
+    size_t count = size / sizeof(OneWireSymbol);
+    if (count > max) count = max;
+    memcpy(capture, items, count * sizeof(OneWireSymbol));
+    vRingbufferReturnItem(rxRing, items);
+    return count;
+}
+
+  public:
+
+OneWireRMT() {}
+
+//
+// Reset pulse. Returns 1 if a device asserted a presence pulse.
+//
+uint8_t reset(void)
+{
+    OneWireSymbol tx[1], rx[OW_RMT_MAX_SYMBOLS];
+    size_t n = owrmt_encode_reset(tx);
+    size_t got = transfer(tx, n, rx, OW_RMT_MAX_SYMBOLS);
+    return owrmt_decode_presence(rx, got) ? 1 : 0;
+}
+
+void write_bit(uint8_t v)
+{
+    OneWireSymbol tx[1];
+    transmit(tx, owrmt_encode_write_bit(v, tx));
+}
+
+uint8_t read_bit(void)
+{
+    OneWireSymbol tx[1], rx[OW_RMT_MAX_SYMBOLS];
+    uint8_t v;
+    size_t n = owrmt_encode_read_bit(tx);
+    owrmt_decode_bits(rx, transfer(tx, n, rx, OW_RMT_MAX_SYMBOLS), &v);
+    return v & 1;
+}
+
+void write(uint8_t v)
+{
+    OneWireSymbol tx[OW_RMT_BYTE_SYMBOLS];
+    transmit(tx, owrmt_encode_write(v, tx));
+}
+
+void write_bytes(const uint8_t *buf, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++)
+        write(buf[i]);
+}
+
+uint8_t read()
+{
+    OneWireSymbol tx[OW_RMT_BYTE_SYMBOLS], rx[OW_RMT_MAX_SYMBOLS];
+    uint8_t v;
+    size_t n = owrmt_encode_read(tx);
+    owrmt_decode_bits(rx, transfer(tx, n, rx, OW_RMT_MAX_SYMBOLS), &v);
+    return v;
+}
+
+void read_bytes(uint8_t *buf, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++)
+        buf[i] = read();
+}
+
+void skip()
+{
+    write(0xCC);
+}
+
+};
+
+#endif // OneWireRMT_h
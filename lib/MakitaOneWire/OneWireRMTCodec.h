@@ -0,0 +1,138 @@
+#ifndef OneWireRMTCodec_h
+#define OneWireRMTCodec_h
+
+//
+// Encode/decode Makita OneWire slots as RMT symbols.
+//
+// This header has no ESP-IDF dependencies so the same code runs on the
+// target (OneWireRMT.h) and against the host fake (OneWireRMTFake.h).
+// Durations are in microseconds (RMT clocked at 1 MHz) and mirror the
+// bit-banged timings in OneWire2.h.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OW_RMT_RESET_LOW_US     750
+#define OW_RMT_RESET_WAIT_US    480     // 70 us to presence sample + 410 us
+#define OW_RMT_WRITE1_LOW_US    12
+#define OW_RMT_WRITE1_HIGH_US   120
+#define OW_RMT_WRITE0_LOW_US    100
+#define OW_RMT_WRITE0_HIGH_US   30
+#define OW_RMT_READ_LOW_US      10
+#define OW_RMT_READ_HIGH_US     63
+#define OW_RMT_READ_SAMPLE_US   20      // a slot held low past this reads 0
+#define OW_RMT_BYTE_GAP_US      90      // leading gap of write()/read()
+#define OW_RMT_RESET_MIN_US     400     // shortest low accepted as our reset
+#define OW_RMT_PRESENCE_MIN_US  30      // shortest low accepted as presence
+#define OW_RMT_RX_IDLE_US       150     // RX capture ends after this much high
+
+// Symbols emitted per byte: one gap symbol plus eight slots
+#define OW_RMT_BYTE_SYMBOLS     9
+
+// Same layout as rmt_item32_t (IDF 4.x) and rmt_symbol_word_t (IDF 5.x)
+struct OneWireSymbol {
+    uint32_t duration0 : 15;
+    uint32_t level0 : 1;
+    uint32_t duration1 : 15;
+    uint32_t level1 : 1;
+};
+
+static inline OneWireSymbol owrmt_symbol(uint16_t d0, uint8_t l0, uint16_t d1, uint8_t l1)
+{
+    OneWireSymbol s;
+    s.duration0 = d0;
+    s.level0 = l0;
+    s.duration1 = d1;
+    s.level1 = l1;
+    return s;
+}
+
+// Reset pulse followed by the presence window. Returns symbols written.
+static inline size_t owrmt_encode_reset(OneWireSymbol *out)
+{
+    out[0] = owrmt_symbol(OW_RMT_RESET_LOW_US, 0, OW_RMT_RESET_WAIT_US, 1);
+    return 1;
+}
+
+// Idle (released) line for us microseconds. A zero duration would end the
+// RMT transmission, so the time is split over both halves.
+static inline size_t owrmt_encode_gap(uint16_t us, OneWireSymbol *out)
+{
+    if (us < 2) return 0;
+    out[0] = owrmt_symbol(us / 2, 1, us - us / 2, 1);
+    return 1;
+}
+
+static inline size_t owrmt_encode_write_bit(uint8_t v, OneWireSymbol *out)
+{
+    if (v & 1) {
+        out[0] = owrmt_symbol(OW_RMT_WRITE1_LOW_US, 0, OW_RMT_WRITE1_HIGH_US, 1);
+    } else {
+        out[0] = owrmt_symbol(OW_RMT_WRITE0_LOW_US, 0, OW_RMT_WRITE0_HIGH_US, 1);
+    }
+    return 1;
+}
+
+static inline size_t owrmt_encode_read_bit(OneWireSymbol *out)
+{
+    out[0] = owrmt_symbol(OW_RMT_READ_LOW_US, 0, OW_RMT_READ_HIGH_US, 1);
+    return 1;
+}
+
+// Gap plus eight write slots, LSB first
+static inline size_t owrmt_encode_write(uint8_t v, OneWireSymbol *out)
+{
+    size_t n = owrmt_encode_gap(OW_RMT_BYTE_GAP_US, out);
+    for (uint8_t mask = 0x01; mask; mask <<= 1) {
+        n += owrmt_encode_write_bit((v & mask) ? 1 : 0, &out[n]);
+    }
+    return n;
+}
+
+// Gap plus eight read slots
+static inline size_t owrmt_encode_read(OneWireSymbol *out)
+{
+    size_t n = owrmt_encode_gap(OW_RMT_BYTE_GAP_US, out);
+    for (uint8_t i = 0; i < 8; i++) {
+        n += owrmt_encode_read_bit(&out[n]);
+    }
+    return n;
+}
+
+// Collect the low periods of an RX capture in order. The capture starts at
+// the first falling edge, so highs only separate the lows.
+static inline size_t owrmt_low_pulses(const OneWireSymbol *in, size_t n, uint16_t *lows, size_t max)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n && count < max; i++) {
+        if (in[i].level0 == 0 && in[i].duration0) lows[count++] = in[i].duration0;
+        if (count < max && in[i].level1 == 0 && in[i].duration1) lows[count++] = in[i].duration1;
+        if (in[i].duration0 == 0 || in[i].duration1 == 0) break;   // end marker
+    }
+    return count;
+}
+
+// True if the capture shows our reset pulse followed by a presence pulse
+static inline bool owrmt_decode_presence(const OneWireSymbol *in, size_t n)
+{
+    uint16_t lows[2];
+    if (owrmt_low_pulses(in, n, lows, 2) < 2) return false;
+    return lows[0] >= OW_RMT_RESET_MIN_US && lows[1] >= OW_RMT_PRESENCE_MIN_US;
+}
+
+// Decode up to eight read slots, LSB first. Returns the number of slots
+// found; missing slots read as 1, like a released line.
+static inline size_t owrmt_decode_bits(const OneWireSymbol *in, size_t n, uint8_t *value)
+{
+    uint16_t lows[8];
+    size_t count = owrmt_low_pulses(in, n, lows, 8);
+
+    *value = 0xFF;
+    for (size_t i = 0; i < count; i++) {
+        if (lows[i] >= OW_RMT_READ_SAMPLE_US) *value &= ~(1 << i);
+    }
+    return count;
+}
+
+#endif // OneWireRMTCodec_h
@@ -0,0 +1,166 @@
+#ifndef OneWireRMTFake_h
+#define OneWireRMTFake_h
+
+//
+// Host-side stand-in for the RMT TX/RX pair and the battery on the other
+// end of the wire. transmit() takes the symbols OneWireRMT would send and
+// returns what the RX channel would capture, with a simulated slave
+// answering resets and read slots. Bytes the master writes are decoded back
+// into written[] so encode paths can be checked against the wire.
+//
+
+#include <string.h>
+#include "OneWireRMTCodec.h"
+
+#define OW_RMT_FAKE_BUF 64
+
+class OneWireRMTFake
+{
+  public:
+    bool present;                       // answer resets with presence
+    uint16_t presenceDelayUs;
+    uint16_t presenceLowUs;
+    uint16_t slaveLowUs;                // how long the slave holds a 0 bit
+
+    uint8_t reply[OW_RMT_FAKE_BUF];     // bytes returned by read slots
+    size_t replyLen;
+    size_t replyPos;
+
+    uint8_t written[OW_RMT_FAKE_BUF];   // bytes decoded from write slots
+    size_t writtenLen;
+
+OneWireRMTFake() { clear(); }
+
+void clear()
+{
+    present = true;
+    presenceDelayUs = 35;
+    presenceLowUs = 100;
+    slaveLowUs = 33;
+    replyLen = replyPos = 0;
+    writtenLen = 0;
+    readBit = 0;
+    writeBits = 0;
+}
+
+void queue(const uint8_t *buf, size_t count)
+{
+    for (size_t i = 0; i < count && replyLen < OW_RMT_FAKE_BUF; i++) {
+        reply[replyLen++] = buf[i];
+    }
+}
+
+//
+// Play tx on the simulated wire and return the capture in rx. Returns the
+// number of RX symbols, 0 if the line never left idle.
+//
+size_t transmit(const OneWireSymbol *tx, size_t n, OneWireSymbol *rx, size_t rxMax)
+{
+    segCount = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint16_t d0 = tx[i].duration0, d1 = tx[i].duration1;
+
+        if (tx[i].level0 == 1) {            // gap symbol
+            high(d0);
+            high(d1);
+        } else if (d0 >= OW_RMT_RESET_MIN_US) {
+            low(d0);
+            if (present && d1 > presenceDelayUs + presenceLowUs) {
+                high(presenceDelayUs);
+                low(presenceLowUs);
+                high(d1 - presenceDelayUs - presenceLowUs);
+            } else {
+                high(d1);
+            }
+        } else if (d0 <= OW_RMT_READ_LOW_US) {
+            // Read slot: the slave stretches the low for a 0 bit
+            uint16_t slot = d0 + d1;
+            uint16_t hold = nextReplyBit() ? d0 : (slaveLowUs > d0 ? slaveLowUs : d0);
+            low(hold);
+            high(slot - hold);
+        } else {
+            // Write slot: record the bit the slave would sample
+            recordWriteBit(d0 < OW_RMT_READ_SAMPLE_US ? 1 : 0);
+            low(d0);
+            high(d1);
+        }
+    }
+
+    return capture(rx, rxMax);
+}
+
+  private:
+    uint16_t segLevel[OW_RMT_FAKE_BUF * 9];
+    uint16_t segUs[OW_RMT_FAKE_BUF * 9];
+    size_t segCount;
+    uint8_t readBit;
+    uint8_t readByte;
+    uint8_t writeBits;
+    uint8_t writeByte;
+
+void low(uint16_t us) { segment(0, us); }
+void high(uint16_t us) { segment(1, us); }
+
+void segment(uint8_t level, uint16_t us)
+{
+    if (!us) return;
+    if (segCount && segLevel[segCount - 1] == level) {
+        segUs[segCount - 1] += us;
+    } else if (segCount < sizeof(segUs) / sizeof(segUs[0])) {
+        segLevel[segCount] = level;
+        segUs[segCount] = us;
+        segCount++;
+    }
+}
+
+uint8_t nextReplyBit()
+{
+    if (readBit == 0) {
+        readByte = replyPos < replyLen ? reply[replyPos++] : 0xFF;
+    }
+    uint8_t bit = (readByte >> readBit) & 1;
+    readBit = (readBit + 1) & 7;
+    return bit;
+}
+
+void recordWriteBit(uint8_t bit)
+{
+    if (writeBits == 0) writeByte = 0;
+    writeByte |= bit << writeBits;
+    if (++writeBits == 8) {
+        writeBits = 0;
+        if (writtenLen < OW_RMT_FAKE_BUF) written[writtenLen++] = writeByte;
+    }
+}
+
+// Pack the segments the way the RX channel reports them: starting at the
+// first falling edge and ending once the line has been idle long enough.
+size_t capture(OneWireSymbol *rx, size_t rxMax)
+{
+    size_t first = 0;
+    while (first < segCount && segLevel[first] == 1) first++;
+
+    size_t n = 0;
+    bool half = false;
+    for (size_t i = first; i < segCount && n < rxMax; i++) {
+        bool idle = segLevel[i] == 1 && segUs[i] >= OW_RMT_RX_IDLE_US;
+        uint16_t us = idle ? 0 : segUs[i];
+
+        if (!half) {
+            rx[n] = owrmt_symbol(us, segLevel[i], 0, 0);
+        } else {
+            rx[n].duration1 = us;
+            rx[n].level1 = segLevel[i];
+            n++;
+        }
+        half = !half;
+        if (idle) break;
+    }
+    if (half && n < rxMax) n++;
+    return n;
+}
+
+};
+
+#endif // OneWireRMTFake_h
@@ -0,0 +1,87 @@
+"""
+Build the compressed web UI.
+
+Extracts INDEX_HTML from src/web_interface.h, minifies it, gzips it and
+writes src/web_interface_gz.h with the bytes and a strong ETag. Runs as a
+PlatformIO pre-build script for the web environments; it can also be run by
+hand:
+
+    python3 scripts/build_web.py
+"""
+
+import gzip
+import hashlib
+import os
+import re
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    ROOT = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SOURCE = os.path.join(ROOT, "src", "web_interface.h")
+OUTPUT = os.path.join(ROOT, "src", "web_interface_gz.h")
+
+
+def extract(text):
+    match = re.search(r'R"rawliteral\((.*)\)rawliteral"', text, re.S)
+    if not match:
+        raise SystemExit("build_web: INDEX_HTML not found in " + SOURCE)
+    return match.group(1)
+
+
+def minify(html):
+    # Conservative: drop CSS block comments, indentation, blank lines and
+    # whole-line // comments. Newlines stay so JS semicolon insertion and
+    # <pre>-like content are unaffected.
+    html = re.sub(r"/\*.*?\*/", "", html, flags=re.S)
+    lines = []
+    for line in html.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def render(data, etag):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return (
+        "// Generated by scripts/build_web.py from web_interface.h - do not edit\n"
+        "#ifndef WEB_INTERFACE_GZ_H\n"
+        "#define WEB_INTERFACE_GZ_H\n"
+        "\n"
+        "#define INDEX_HTML_GZ_LEN %d\n"
+        "#define INDEX_HTML_ETAG \"\\\"%s\\\"\"\n"
+        "\n"
+        "const uint8_t INDEX_HTML_GZ[] PROGMEM = {\n"
+        "%s\n"
+        "};\n"
+        "\n"
+        "#endif // WEB_INTERFACE_GZ_H\n" % (len(data), etag, "\n".join(rows))
+    )
+
+
+def main():
+    with open(SOURCE, encoding="utf-8") as f:
+        html = minify(extract(f.read()))
+
+    # mtime=0 keeps the output, and so the ETag, identical across builds
+    data = gzip.compress(html.encode("utf-8"), compresslevel=9, mtime=0)
+    etag = hashlib.sha256(data).hexdigest()[:16]
+    out = render(data, etag)
+
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, encoding="utf-8") as f:
+            if f.read() == out:
+                return
+    with open(OUTPUT, "w", encoding="utf-8") as f:
+        f.write(out)
+    print("build_web: %s, %d -> %d bytes, etag %s"
+          % (os.path.basename(OUTPUT), len(html), len(data), etag))
+
+
+main()
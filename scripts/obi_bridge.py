@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Talk to the serial bridge with COBS + CRC-16 response framing.
+
+Sends the 0x01 version request asking for BRIDGE_FRAMING_COBS, then sends
+each given command frame and prints the checked response. Frames that fail
+their CRC are reported and skipped rather than ending the session.
+
+    python3 scripts/obi_bridge.py /dev/ttyACM0 33:AA00:32 CC:D70000FF:29
+    python3 scripts/obi_bridge.py /dev/ttyACM0 --stream 200 > samples.csv
+
+Each command is CMD:DATA:RSP_LEN in hex (DATA may be empty) and RSP_LEN in
+decimal. --stream PERIOD_MS starts the 0x54 telemetry stream and prints its
+records as CSV until interrupted, reporting gaps in the sequence numbers.
+Needs pyserial for the port; decode_frame() and the helpers below use only
+the standard library and can be imported by test code.
+"""
+
+import struct
+import sys
+
+FRAMING_RAW = 0
+FRAMING_COBS = 1
+
+RECORD = struct.Struct("<IIH5HhhB")    # StreamRecord in src/main.cpp
+RECORD_FIELDS = ("sequence", "time_ms", "pack_mv", "cell1_mv", "cell2_mv", "cell3_mv",
+                 "cell4_mv", "cell5_mv", "temp_cell_centic", "temp_mosfet_centic", "status")
+
+
+class FrameError(ValueError):
+    pass
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE, as bridgeCrc16() in src/bridge_framing.h."""
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + (0 if code > 1 else 1):
+            raise FrameError("bad COBS code at byte %d" % i)
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def decode_frame(encoded):
+    """Decode one frame without its 0x00 delimiter into (cmd, data)."""
+    raw = cobs_decode(encoded)
+    if len(raw) < 4:
+        raise FrameError("short frame")
+    body, crc = raw[:-2], raw[-2] | raw[-1] << 8
+    if crc16(body) != crc:
+        raise FrameError("CRC mismatch")
+    if body[1] != len(body) - 2:
+        raise FrameError("length %d, header says %d" % (len(body) - 2, body[1]))
+    return body[0], body[2:]
+
+
+def request(cmd, data=b"", rsp_len=0):
+    return bytes([0x01, len(data), rsp_len, cmd]) + bytes(data)
+
+
+def negotiate(port):
+    """Ask for COBS framing. The reply itself is still raw."""
+    port.write(request(0x01, bytes([FRAMING_COBS]), 4))
+    reply = port.read(6)
+    if len(reply) != 6 or reply[0] != 0x01:
+        raise FrameError("no version reply")
+    print("firmware %d.%d.%d, framing %d" % (reply[2], reply[3], reply[4], reply[5]), file=sys.stderr)
+    return reply[5] == FRAMING_COBS
+
+
+def read_frame(port):
+    encoded = bytearray()
+    while True:
+        b = port.read(1)
+        if not b:
+            raise FrameError("timeout")
+        if b[0] == 0:
+            return decode_frame(bytes(encoded))
+        encoded += b
+
+
+def stream(port, period_ms):
+    port.write(request(0x54, struct.pack("<H", period_ms), 3))
+    while True:
+        cmd, payload = read_frame(port)
+        if cmd == 0x54:
+            break
+    status, period = payload[0], payload[1] | payload[2] << 8
+    if status:
+        raise FrameError("stream refused (no battery?)")
+    print("streaming every %d ms" % period, file=sys.stderr)
+    print(",".join(RECORD_FIELDS))
+
+    expected = 0
+    try:
+        while True:
+            try:
+                cmd, payload = read_frame(port)
+            except FrameError as e:
+                print("skipped frame: %s" % e, file=sys.stderr)
+                continue
+            if cmd != 0x55 or len(payload) != RECORD.size:
+                continue
+            record = RECORD.unpack(payload)
+            if record[0] != expected:
+                print("missed %d samples" % (record[0] - expected), file=sys.stderr)
+            expected = record[0] + 1
+            print(",".join(str(v) for v in record), flush=True)
+    except KeyboardInterrupt:
+        port.write(request(0x54, struct.pack("<H", 0), 3))
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+
+    import serial
+
+    with serial.Serial(argv[1], 115200, timeout=5) as port:
+        port.reset_input_buffer()
+        if not negotiate(port):
+            print("firmware kept raw framing", file=sys.stderr)
+            return 1
+        if len(argv) == 4 and argv[2] == "--stream":
+            stream(port, int(argv[3]))
+            return 0
+        for spec in argv[2:]:
+            cmd, data, rsp_len = spec.split(":")
+            port.write(request(int(cmd, 16), bytes.fromhex(data), int(rsp_len)))
+            try:
+                rcmd, payload = read_frame(port)
+                print("%02X: %s" % (rcmd, payload.hex(" ")))
+            except FrameError as e:
+                print("%s: %s" % (spec, e), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
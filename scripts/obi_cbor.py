@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+Decode the CBOR bodies of /api/read and /api/voltages.
+
+A minimal CBOR decoder (RFC 8949) covering what the firmware's CborWriter
+emits: integers, text, booleans, and definite or indefinite maps and arrays.
+It uses only the standard library.
+
+    python3 scripts/obi_cbor.py http://obi-esp32.local/api/read
+    python3 scripts/obi_cbor.py read.cbor
+    curl -sH 'Accept: application/cbor' http://obi-esp32.local/api/read | python3 scripts/obi_cbor.py -
+
+Prints the decoded value as JSON. decode() can be imported by test code.
+"""
+
+import json
+import struct
+import sys
+import urllib.request
+
+BREAK = object()
+
+
+class CborError(ValueError):
+    pass
+
+
+class _Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise CborError("truncated at byte %d" % self.pos)
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def argument(self, info):
+        if info < 24:
+            return info
+        if info == 24:
+            return self.take(1)[0]
+        if info == 25:
+            return struct.unpack(">H", self.take(2))[0]
+        if info == 26:
+            return struct.unpack(">I", self.take(4))[0]
+        if info == 27:
+            return struct.unpack(">Q", self.take(8))[0]
+        if info == 31:
+            return None     # indefinite length
+        raise CborError("reserved additional info %d" % info)
+
+    def item(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 0x1F
+
+        if initial == 0xFF:
+            return BREAK
+        if major == 7:
+            simple = {20: False, 21: True, 22: None}
+            if info in simple:
+                return simple[info]
+            if info == 25:
+                return _half(self.take(2))
+            if info == 26:
+                return struct.unpack(">f", self.take(4))[0]
+            if info == 27:
+                return struct.unpack(">d", self.take(8))[0]
+            raise CborError("unsupported simple value %d" % info)
+
+        arg = self.argument(info)
+        if major == 0:
+            return arg
+        if major == 1:
+            return -1 - arg
+        if major in (2, 3):
+            if arg is None:
+                raise CborError("indefinite strings are not supported")
+            raw = self.take(arg)
+            return raw.decode("utf-8") if major == 3 else raw
+        if major == 4:
+            return self.sequence(arg, list)
+        if major == 5:
+            return self.sequence(arg, dict)
+        raise CborError("tags are not supported")
+
+    def sequence(self, count, kind):
+        items = []
+        while count is None or len(items) < (count * (2 if kind is dict else 1)):
+            value = self.item()
+            if value is BREAK:
+                if count is not None:
+                    raise CborError("unexpected break")
+                break
+            items.append(value)
+        if kind is list:
+            return items
+        if len(items) % 2:
+            raise CborError("map with an odd number of items")
+        return dict(zip(items[0::2], items[1::2]))
+
+
+def _half(raw):
+    bits = struct.unpack(">H", raw)[0]
+    exp, frac = (bits >> 10) & 0x1F, bits & 0x3FF
+    if exp == 0:
+        value = frac * 2.0 ** -24
+    elif exp == 31:
+        value = float("inf") if not frac else float("nan")
+    else:
+        value = (frac + 1024) * 2.0 ** (exp - 25)
+    return -value if bits & 0x8000 else value
+
+
+def decode(data):
+    """Decode one CBOR item from bytes; trailing bytes are an error."""
+    reader = _Reader(bytes(data))
+    value = reader.item()
+    if value is BREAK:
+        raise CborError("unexpected break")
+    if reader.pos != len(reader.data):
+        raise CborError("%d trailing bytes" % (len(reader.data) - reader.pos))
+    return value
+
+
+def _load(source):
+    if source == "-":
+        return sys.stdin.buffer.read()
+    if source.startswith(("http://", "https://")):
+        request = urllib.request.Request(source, headers={"Accept": "application/cbor"})
+        with urllib.request.urlopen(request, timeout=10) as response:
+            return response.read()
+    with open(source, "rb") as f:
+        return f.read()
+
+
+def main(argv):
+    if len(argv) != 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+    print(json.dumps(decode(_load(argv[1])), indent=2))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
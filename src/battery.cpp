@@ -0,0 +1,1042 @@
+/**
+ * Makita battery protocol - enable control, bus transfers and frame parsing
+ *
+ * FUNCTIONAL REQUIREMENTS:
+ * 1. Drive the enable pin and wake the BMS (adaptive presence polling)
+ * 2. Run 0x33 / 0xCC / F0513 exchanges on the OneWire engine with retries
+ * 3. Parse info, model and voltage frames into BatteryData
+ * 4. Probe for a pack before any exchange and cache "no battery" until
+ *    the data or enable line sees an edge
+ * 5. Remember per ROM ID which command family (modern / F0513) a pack
+ *    answers, so reads skip the path that is known to fail
+ * 6. Build unchanged for the ESP32 target and natively on Linux
+ *    (-DONEWIRE_HOST), where the wire is simulated by OneWireHalHost.h
+ *
+ * Everything here runs on the bus owner: the bus task on the target, the
+ * simulation driver on the host.
+ */
+
+#include "battery.h"
+#include "battery_frames.h"
+
+#if PROTO_CACHE_NVS && !defined(ONEWIRE_HOST)
+#include <Preferences.h>
+#endif
+
+BusWire makita;
+OneWireEngine<BusWire> busEngine(makita);
+
+BatteryData batteryData;
+
+WakeStats wakeStats[WAKE_STATS_SLOTS];
+uint8_t wakeStatsNext = 0;
+
+// Wake latency of the current enable window, until a ROM ID claims it
+uint32_t sessionWakeMs = 0;
+bool sessionWakePending = false;
+
+// Settle time of the current enable window, reported by the first request
+// that runs in it
+uint32_t sessionSettleMs = 0;
+
+// Whether the current enable window found a pack. Exchanges fail fast
+// without touching the bus when it did not.
+bool sessionPresent = false;
+
+// Cached "no battery" result of the last probe, cleared by a line edge
+bool presenceAbsent = false;
+uint32_t presenceCheckedAt = 0;
+volatile bool presenceEdge = false;
+
+ProtocolCacheEntry protocolCache[PROTO_CACHE_SLOTS];
+uint32_t protocolCacheTick = 0;
+bool protocolCacheDirty = false;    // changed since the last NVS write
+bool protocolCacheSaved = false;
+uint32_t protocolCacheSavedMs = 0;
+
+FrameStats frameStats[FRAME_KINDS];
+
+BusMetrics busMetrics;
+const uint16_t latencyBoundsMs[LATENCY_BUCKETS - 1] = {5, 10, 20, 50, 100, 200, 500, 1000};
+
+// ROM ID of the pack in the current enable window, once a 0x33 exchange
+// has returned it
+uint8_t sessionRomId[8];
+bool sessionRomKnown = false;
+
+// ------------------------------------------------------------------
+// Enable pin control
+// ------------------------------------------------------------------
+void setEnable(bool high) {
+    digitalWrite(ENABLE_PIN, high ? HIGH : LOW);
+}
+
+void triggerPower() {
+    busMetrics.powerCycles++;
+    setEnable(false);
+    busSleep(200);
+    setEnable(true);
+#if WAKE_ADAPTIVE
+    sessionWakePending = true;
+    wakeBattery(WAKE_DEADLINE_MS, &sessionWakeMs);
+#else
+    busSleep(500);
+#endif
+}
+
+// Poll for a presence pulse until the BMS answers or WAKE_DEADLINE_MS runs
+// out. Each reset takes ~1.2 ms; the pause between them doubles from
+// WAKE_BACKOFF_MIN_MS up to WAKE_BACKOFF_MAX_MS.
+bool wakeBattery(uint32_t deadlineMs, uint32_t *latencyMs) {
+    uint32_t start = millis();
+    uint32_t backoff = WAKE_BACKOFF_MIN_MS;
+
+    while (true) {
+        busMetrics.wakePolls++;
+        if (makita.reset()) {
+            *latencyMs = millis() - start;
+            return true;
+        }
+
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= deadlineMs) {
+            busMetrics.wakeTimeouts++;
+            *latencyMs = elapsed;
+            return false;
+        }
+
+        uint32_t remaining = deadlineMs - elapsed;
+        busSleep(backoff < remaining ? backoff : remaining);
+        if (backoff < WAKE_BACKOFF_MAX_MS) backoff *= 2;
+    }
+}
+
+// Attribute the pending wake latency to the battery that just identified
+// itself. Called with the ROM ID of every successful 0x33 exchange.
+void recordWakeLatency(const uint8_t *romId) {
+    if (!sessionWakePending) return;
+    sessionWakePending = false;
+
+    WakeStats *ws = nullptr;
+    for (int i = 0; i < WAKE_STATS_SLOTS; i++) {
+        if (wakeStats[i].samples && memcmp(wakeStats[i].romId, romId, 8) == 0) {
+            ws = &wakeStats[i];
+            break;
+        }
+    }
+
+    if (!ws) {
+        ws = &wakeStats[wakeStatsNext];
+        wakeStatsNext = (wakeStatsNext + 1) % WAKE_STATS_SLOTS;
+        memcpy(ws->romId, romId, 8);
+        ws->samples = 0;
+        ws->minMs = 0xFFFF;
+        ws->maxMs = 0;
+    }
+
+    uint16_t ms = sessionWakeMs > 0xFFFF ? 0xFFFF : sessionWakeMs;
+    ws->lastMs = ms;
+    if (ms < ws->minMs) ws->minMs = ms;
+    if (ms > ws->maxMs) ws->maxMs = ms;
+    if (ws->samples < 0xFFFF) ws->samples++;
+
+    log_i("Wake %u ms (min %u, max %u, n=%u) ROM %02X%02X%02X%02X%02X%02X%02X%02X",
+          ms, ws->minMs, ws->maxMs, ws->samples,
+          romId[0], romId[1], romId[2], romId[3],
+          romId[4], romId[5], romId[6], romId[7]);
+}
+
+// ------------------------------------------------------------------
+// Presence probe
+// ------------------------------------------------------------------
+
+#ifndef ONEWIRE_HOST
+static void IRAM_ATTR onPresenceEdge() {
+    presenceEdge = true;
+}
+#endif
+
+// Watch the data line for an insertion while the bus is idle. Our own
+// transfers toggle it, so this is only armed between sessions. Enable is
+// an output we drive, so a pack cannot produce an edge there.
+static void presenceArm(bool arm) {
+#ifndef ONEWIRE_HOST
+    if (arm) {
+        presenceEdge = false;
+        attachInterrupt(digitalPinToInterrupt(ONEWIRE_PIN), onPresenceEdge, CHANGE);
+    } else {
+        detachInterrupt(digitalPinToInterrupt(ONEWIRE_PIN));
+    }
+#else
+    (void)arm;
+#endif
+}
+
+// Probe budget: the full wake deadline unless the last probe already found
+// no pack and the data line has been quiet since. Only then is the probe
+// cut to PRESENCE_PROBE_MS, or twice the slowest wake seen from a known
+// pack, so a slow pack is never written off on a short probe.
+static uint32_t presenceBudgetMs() {
+    if (!presenceAbsent || presenceEdge) return WAKE_DEADLINE_MS;
+
+    uint32_t budget = PRESENCE_PROBE_MS;
+    for (int i = 0; i < WAKE_STATS_SLOTS; i++) {
+        if (wakeStats[i].samples && wakeStats[i].maxMs * 2u > budget) {
+            budget = wakeStats[i].maxMs * 2u;
+        }
+    }
+    return budget < WAKE_DEADLINE_MS ? budget : WAKE_DEADLINE_MS;
+}
+
+// A session is one enable window: the battery is powered once, any number
+// of exchanges run back to back, then it is released again. Returns false
+// (and leaves enable low) if no pack answered the probe.
+bool beginSession() {
+    uint32_t start = millis();
+
+    sessionRomKnown = false;
+    sessionSettleMs = 0;
+
+    if (presenceAbsent && !presenceEdge && millis() - presenceCheckedAt < PRESENCE_CACHE_MS) {
+        sessionPresent = false;
+        return false;
+    }
+
+    presenceArm(false);
+    setEnable(true);
+#if WAKE_ADAPTIVE
+    sessionWakePending = true;
+    sessionPresent = wakeBattery(presenceBudgetMs(), &sessionWakeMs);
+#else
+    busSleep(400);
+    sessionPresent = makita.reset();
+#endif
+    sessionSettleMs = millis() - start;
+
+    presenceAbsent = !sessionPresent;
+    presenceCheckedAt = millis();
+    if (!sessionPresent) log_i("No battery (probe %u ms)", sessionSettleMs);
+    return sessionPresent;
+}
+
+void endSession() {
+    setEnable(false);
+    if (presenceAbsent) presenceArm(true);
+    protocolCacheFlush();
+}
+
+// ------------------------------------------------------------------
+// Protocol family cache
+// ------------------------------------------------------------------
+
+// Only written when an entry is added or changes family, not on every hit,
+// to keep flash wear down.
+static void protocolCacheSave() {
+#if PROTO_CACHE_NVS && !defined(ONEWIRE_HOST)
+    Preferences prefs;
+    if (!prefs.begin("obi", false)) return;
+    prefs.putBytes("proto", protocolCache, sizeof(protocolCache));
+    prefs.end();
+#endif
+}
+
+// Write a changed cache once the enable window has closed, at most every
+// PROTO_CACHE_SAVE_MS, so a flash write never lands inside a bus exchange
+void protocolCacheFlush() {
+    if (!protocolCacheDirty) return;
+    if (protocolCacheSaved && millis() - protocolCacheSavedMs < PROTO_CACHE_SAVE_MS) return;
+
+    protocolCacheSave();
+    protocolCacheDirty = false;
+    protocolCacheSaved = true;
+    protocolCacheSavedMs = millis();
+}
+
+void protocolCacheLoad() {
+#if PROTO_CACHE_NVS && !defined(ONEWIRE_HOST)
+    Preferences prefs;
+    if (!prefs.begin("obi", true)) return;
+    if (prefs.getBytesLength("proto") == sizeof(protocolCache)) {
+        prefs.getBytes("proto", protocolCache, sizeof(protocolCache));
+    }
+    prefs.end();
+
+    for (int i = 0; i < PROTO_CACHE_SLOTS; i++) {
+        if (protocolCache[i].lastUsed > protocolCacheTick) {
+            protocolCacheTick = protocolCache[i].lastUsed;
+        }
+    }
+#endif
+}
+
+static ProtocolCacheEntry *protocolFind(const uint8_t *romId) {
+    for (int i = 0; i < PROTO_CACHE_SLOTS; i++) {
+        if (protocolCache[i].family != PROTO_UNKNOWN &&
+            memcmp(protocolCache[i].romId, romId, 8) == 0) {
+            return &protocolCache[i];
+        }
+    }
+    return nullptr;
+}
+
+// Family without touching the LRU order, for reporting
+uint8_t protocolPeek(const uint8_t *romId) {
+    const ProtocolCacheEntry *e = protocolFind(romId);
+    if (!e) return PROTO_UNKNOWN;
+    return e->family;
+}
+
+uint8_t protocolLookup(const uint8_t *romId) {
+    ProtocolCacheEntry *e = protocolFind(romId);
+    if (!e) return PROTO_UNKNOWN;
+    e->lastUsed = ++protocolCacheTick;
+    return e->family;
+}
+
+void protocolRemember(const uint8_t *romId, uint8_t family) {
+    ProtocolCacheEntry *e = protocolFind(romId);
+
+    if (!e) {
+        if (family == PROTO_UNKNOWN) return;
+
+        // Free slot first, otherwise the least recently used one
+        e = &protocolCache[0];
+        for (int i = 0; i < PROTO_CACHE_SLOTS; i++) {
+            if (protocolCache[i].family == PROTO_UNKNOWN) {
+                e = &protocolCache[i];
+                break;
+            }
+            if (protocolCache[i].lastUsed < e->lastUsed) e = &protocolCache[i];
+        }
+        memcpy(e->romId, romId, 8);
+        e->family = PROTO_UNKNOWN;
+    }
+
+    e->lastUsed = ++protocolCacheTick;
+    if (e->family != family) {
+        e->family = family;
+        protocolCacheDirty = true;
+    }
+}
+
+const char *protocolName(uint8_t family) {
+    switch (family) {
+        case PROTO_MODERN: return "modern";
+        case PROTO_F0513:  return "f0513";
+        default:           return "unknown";
+    }
+}
+
+// ------------------------------------------------------------------
+// Bus scheduling
+// ------------------------------------------------------------------
+
+// On the target, transfers only run on the bus task, so sleeping just hands
+// the CPU back to the loop task (web server, OTA, serial bridge).
+void busYield() {
+    delay(1);
+}
+
+void busSleep(uint32_t ms) {
+    uint32_t start = millis();
+    while (millis() - start < ms) {
+        busYield();
+    }
+}
+
+// Run a transfer on the engine, yielding whenever it sleeps. Returns false
+// if a OW_OP_RESET step saw no presence pulse.
+bool busRun(const OneWireOp *ops, const byte *tx, byte *rx) {
+    uint8_t status;
+
+    busEngine.start(ops, tx, rx);
+    while ((status = busEngine.poll()) == OW_BUSY) {
+        busYield();
+    }
+    return status == OW_DONE;
+}
+
+// ------------------------------------------------------------------
+// Frame validation
+// ------------------------------------------------------------------
+
+// Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1), as used for 1-Wire ROM IDs
+uint8_t onewireCrc8(const uint8_t *data, uint8_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        uint8_t b = *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            uint8_t mix = (crc ^ b) & 0x01;
+            crc >>= 1;
+            if (mix) crc ^= 0x8C;
+            b >>= 1;
+        }
+    }
+    return crc;
+}
+
+const char *frameKindName(uint8_t kind) {
+    switch (kind) {
+        case FRAME_INFO:     return "info";
+        case FRAME_MODEL:    return "model";
+        case FRAME_VOLTAGES: return "voltages";
+        case FRAME_F0513:    return "f0513";
+        default:             return "raw";
+    }
+}
+
+static bool frameBlank(const byte *buf, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        if (buf[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+// Count a rejected attempt. Logged with the time so corruption can be
+// lined up against what else the bus was doing.
+static void frameReject(uint8_t kind, uint8_t result) {
+    FrameStats &fs = frameStats[kind];
+    switch (result) {
+        case FRAME_BLANK:        fs.blank++; break;
+        case FRAME_ROM_MISMATCH: fs.romMismatch++; break;
+        case FRAME_RANGE:        fs.range++; break;
+        default:                 break;     // CRC/ack are counted when seen
+    }
+    fs.lastErrorMs = millis();
+    if (result != FRAME_BLANK) {
+        log_w("Frame %s rejected (%u) at %lu ms", frameKindName(kind), result, (unsigned long)fs.lastErrorMs);
+    }
+}
+
+// The ROM ID segment of a 0x33 exchange: not blank, the same ID as earlier
+// in the session, a plausible date, and (strict mode) a valid CRC8.
+static uint8_t checkRom(uint8_t kind, const byte *rom) {
+    if (frameBlank(rom, 8)) return FRAME_BLANK;
+    if (sessionRomKnown && memcmp(rom, sessionRomId, 8) != 0) return FRAME_ROM_MISMATCH;
+
+    // Bytes 0-2 are the manufacturing date (YY MM DD)
+    if (rom[0] > 99 || rom[1] < 1 || rom[1] > 12 || rom[2] < 1 || rom[2] > 31) return FRAME_RANGE;
+
+    if (onewireCrc8(rom, 7) != rom[7]) {
+        frameStats[kind].badCrc++;
+#if FRAME_STRICT
+        return FRAME_BAD_CRC;
+#endif
+    }
+    return FRAME_OK;
+}
+
+// CC responses end with a 0x06 ack; the bytes read past the end of a
+// shorter frame come back as 0xFF.
+static uint8_t checkAck(uint8_t kind, const byte *rsp, uint8_t len) {
+    while (len && rsp[len - 1] == 0xFF) len--;
+    if (len && rsp[len - 1] == 0x06) return FRAME_OK;
+
+    frameStats[kind].noAck++;
+#if FRAME_STRICT
+    return FRAME_NO_ACK;
+#else
+    return FRAME_OK;
+#endif
+}
+
+// ------------------------------------------------------------------
+// Bus metrics
+// ------------------------------------------------------------------
+
+const char *busOpcodeName(uint8_t op) {
+    switch (op) {
+        case BUS_OP_33:    return "33";
+        case BUS_OP_CC:    return "cc";
+        default:           return "f0513";
+    }
+}
+
+static void latencyRecord(uint8_t op, uint32_t ms) {
+    LatencyHistogram &h = busMetrics.latency[op];
+    uint8_t b = 0;
+    while (b < LATENCY_BUCKETS - 1 && ms > latencyBoundsMs[b]) b++;
+    h.buckets[b]++;
+    h.count++;
+    h.totalMs += ms;
+    if (ms > h.maxMs) h.maxMs = ms;
+}
+
+// Metrics as little-endian u32s for the serial bridge: the six counters,
+// then per opcode count, totalMs, maxMs and the bucket counts. Returns the
+// number of bytes written (0 if max is too small).
+size_t busMetricsEncode(byte *buf, size_t max) {
+    const size_t words = 6 + BUS_OPS * (3 + LATENCY_BUCKETS);
+    if (max < words * 4) return 0;
+
+    uint32_t w[words];
+    size_t n = 0;
+    w[n++] = busMetrics.resets;
+    w[n++] = busMetrics.noPresence;
+    w[n++] = busMetrics.powerCycles;
+    w[n++] = busMetrics.retries;
+    w[n++] = busMetrics.wakePolls;
+    w[n++] = busMetrics.wakeTimeouts;
+    for (int op = 0; op < BUS_OPS; op++) {
+        const LatencyHistogram &h = busMetrics.latency[op];
+        w[n++] = h.count;
+        w[n++] = h.totalMs;
+        w[n++] = h.maxMs;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) w[n++] = h.buckets[b];
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        buf[i*4]     = w[i];
+        buf[i*4 + 1] = w[i] >> 8;
+        buf[i*4 + 2] = w[i] >> 16;
+        buf[i*4 + 3] = w[i] >> 24;
+    }
+    return n * 4;
+}
+
+// ------------------------------------------------------------------
+// OneWire command functions
+// ------------------------------------------------------------------
+
+// 0x33 exchange in two segments: the ROM ID is checked before the command
+// is sent, so a bad ID costs a reset and eight bytes rather than the whole
+// frame. Only a missing presence pulse power-cycles the battery; corrupt
+// or blank frames are simply re-read.
+bool cmdAndRead33(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len,
+                  uint8_t kind, FrameCheck check) {
+    FrameStats &fs = frameStats[kind];
+
+    if (!sessionPresent) {
+        memset(rsp, 0xFF, rsp_len + 8);
+        return false;
+    }
+
+    const OneWireOp romOps[] = {
+        {OW_OP_RESET, 0, 0},
+        {OW_OP_DELAY_US, 0, 310},
+        {OW_OP_WRITE_BYTE, 0x33, 0},
+        {OW_OP_READ, 8, 90},            // 8-byte ROM ID
+        {OW_OP_END, 0, 0}
+    };
+    const OneWireOp cmdOps[] = {
+        {OW_OP_WRITE, cmd_len, 90},     // command
+        {OW_OP_READ, rsp_len, 90},      // response
+        {OW_OP_END, 0, 0}
+    };
+
+    uint32_t start = millis();
+
+    for (int retry = 0; retry < FRAME_RETRIES; retry++) {
+        if (retry) {
+            fs.retries++;
+            busMetrics.retries++;
+        }
+
+        busMetrics.resets++;
+        if (!busRun(romOps, nullptr, rsp)) {
+            fs.noPresence++;
+            busMetrics.noPresence++;
+            triggerPower();
+            continue;
+        }
+
+        uint8_t result = checkRom(kind, rsp);
+        if (result == FRAME_OK) {
+            busRun(cmdOps, cmd, &rsp[8]);
+            // A command with no reply bytes has nothing to validate
+            if (!rsp_len) {
+                result = FRAME_OK;
+            } else if (frameBlank(&rsp[8], rsp_len)) {
+                result = FRAME_BLANK;
+            } else if (check) {
+                result = check(&rsp[8], rsp_len);
+            }
+        }
+
+        if (result != FRAME_OK) {
+            frameReject(kind, result);
+            continue;
+        }
+
+        fs.ok++;
+        latencyRecord(BUS_OP_33, millis() - start);
+        memcpy(sessionRomId, rsp, 8);
+        sessionRomKnown = true;
+        recordWakeLatency(rsp);
+        return true;
+    }
+
+    fs.failures++;
+    latencyRecord(BUS_OP_33, millis() - start);
+    memset(rsp, 0xFF, rsp_len + 8);
+    return false;
+}
+
+bool cmdAndReadCC(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len,
+                  uint8_t kind, FrameCheck check) {
+    FrameStats &fs = frameStats[kind];
+
+    if (!sessionPresent) {
+        memset(rsp, 0xFF, rsp_len);
+        return false;
+    }
+    const OneWireOp ops[] = {
+        {OW_OP_RESET, 0, 0},
+        {OW_OP_DELAY_US, 0, 310},
+        {OW_OP_WRITE_BYTE, 0xCC, 0},
+        {OW_OP_WRITE, cmd_len, 90},     // command
+        {OW_OP_READ, rsp_len, 90},      // response
+        {OW_OP_END, 0, 0}
+    };
+
+    uint32_t start = millis();
+
+    for (int retry = 0; retry < FRAME_RETRIES; retry++) {
+        if (retry) {
+            fs.retries++;
+            busMetrics.retries++;
+        }
+
+        busMetrics.resets++;
+        if (!busRun(ops, cmd, rsp)) {
+            fs.noPresence++;
+            busMetrics.noPresence++;
+            triggerPower();
+            continue;
+        }
+
+        uint8_t result = FRAME_OK;
+        if (!rsp_len) {
+            // nothing to validate
+        } else if (frameBlank(rsp, rsp_len)) {
+            result = FRAME_BLANK;
+        } else if (check) {
+            // F0513 replies are two bare bytes with no ack
+            if (kind != FRAME_F0513) result = checkAck(kind, rsp, rsp_len);
+            if (result == FRAME_OK) result = check(rsp, rsp_len);
+        }
+
+        if (result != FRAME_OK) {
+            frameReject(kind, result);
+            continue;
+        }
+
+        fs.ok++;
+        latencyRecord(BUS_OP_CC, millis() - start);
+        return true;
+    }
+
+    fs.failures++;
+    latencyRecord(BUS_OP_CC, millis() - start);
+    memset(rsp, 0xFF, rsp_len);
+    return false;
+}
+
+// Older (F0513) batteries: CC 99 switches the BMS into the legacy command
+// set, then a single-byte command returns two bytes. rsp receives them in
+// bus order.
+bool cmdAndReadF0513(byte cmd, byte *rsp) {
+    const OneWireOp ops[] = {
+        {OW_OP_RESET_ANY, 0, 0},
+        {OW_OP_DELAY_US, 0, 400},
+        {OW_OP_WRITE_BYTE, 0xCC, 0},
+        {OW_OP_WRITE_BYTE, 0x99, 90},
+        {OW_OP_SLEEP_MS, 0, 400},
+        {OW_OP_RESET_ANY, 0, 0},
+        {OW_OP_DELAY_US, 0, 400},
+        {OW_OP_WRITE_BYTE, cmd, 0},
+        {OW_OP_READ, 2, 90},
+        {OW_OP_END, 0, 0}
+    };
+
+    if (!sessionPresent) {
+        rsp[0] = rsp[1] = 0xFF;
+        return false;
+    }
+
+    uint32_t start = millis();
+    busMetrics.resets += 2;
+    busRun(ops, nullptr, rsp);
+    latencyRecord(BUS_OP_F0513, millis() - start);
+    return rsp[0] != 0xFF && rsp[1] != 0xFF;
+}
+
+// Bridge script: a byte-coded list of bus steps run back to back (see
+// battery.h). Each step is handed to busRun() on its own, so timing within
+// a step is the engine's and steps follow each other with no added gap.
+// The only branch is SCRIPT_SKIP_IF_FF, which jumps forward, so every
+// script terminates.
+uint8_t busScript(const byte *script, uint8_t len, byte *out, uint8_t max) {
+    uint16_t pc = 0;
+    uint16_t n = 2;         // out[0] status, out[1] stop offset
+    uint8_t status = SCRIPT_OK;
+    bool lastBlank = false;
+    OneWireOp ops[2] = {{OW_OP_END, 0, 0}, {OW_OP_END, 0, 0}};
+
+    if (max < 2) return 0;
+    if (!sessionPresent) status = SCRIPT_NO_PRESENCE;
+
+    while (status == SCRIPT_OK && pc < len && script[pc] != SCRIPT_END) {
+        uint8_t code = script[pc];
+        uint8_t arg = pc + 1 < len ? script[pc + 1] : 0;
+        uint16_t size;
+        const byte *tx = nullptr;
+        byte *rx = nullptr;
+
+        uint16_t time = pc + 2 < len ? arg | script[pc + 2] << 8 : 0;
+
+        ops[0] = {OW_OP_END, 0, 0};
+        switch (code) {
+            case SCRIPT_RESET:
+                size = 1;
+                ops[0].code = OW_OP_RESET;
+                break;
+            case SCRIPT_RESET_ANY:
+                size = 1;
+                ops[0].code = OW_OP_RESET_ANY;
+                break;
+            case SCRIPT_WRITE_BYTE:
+                size = 2;
+                ops[0] = {OW_OP_WRITE_BYTE, arg, 0};
+                break;
+            case SCRIPT_SKIP_IF_FF:
+                size = 2;
+                break;
+            case SCRIPT_WRITE:
+                size = 2 + arg;
+                ops[0] = {OW_OP_WRITE, arg, SCRIPT_BYTE_GAP_US};
+                tx = &script[pc + 2];
+                break;
+            case SCRIPT_READ:
+                size = 2;
+                ops[0] = {OW_OP_READ, arg, SCRIPT_BYTE_GAP_US};
+                rx = &out[n];
+                if (n + arg > max) status = SCRIPT_FULL;
+                break;
+            case SCRIPT_DELAY_US:
+                size = 3;
+                ops[0] = {OW_OP_DELAY_US, 0, time};
+                break;
+            case SCRIPT_SLEEP_MS:
+                size = 3;
+                ops[0] = {OW_OP_SLEEP_MS, 0, time};
+                break;
+            default:
+                size = 0;
+                status = SCRIPT_MALFORMED;
+                break;
+        }
+        if (pc + size > len) status = SCRIPT_MALFORMED;
+        if (status != SCRIPT_OK) break;
+
+        if (code == SCRIPT_SKIP_IF_FF) {
+            pc += size;
+            if (lastBlank) pc += arg;
+            continue;
+        }
+
+        if (code == SCRIPT_RESET || code == SCRIPT_RESET_ANY) busMetrics.resets++;
+        if (!busRun(ops, tx, rx)) {
+            busMetrics.noPresence++;
+            status = SCRIPT_NO_PRESENCE;
+            break;
+        }
+        if (code == SCRIPT_READ) {
+            lastBlank = arg && frameBlank(rx, arg);
+            n += arg;
+        }
+        pc += size;
+    }
+
+    out[0] = status;
+    out[1] = pc < len ? pc : len;
+    return n;
+}
+
+// ------------------------------------------------------------------
+// High-level battery functions
+// ------------------------------------------------------------------
+
+// The session* functions assume the enable window is already open.
+
+static uint16_t le16(const byte *p) {
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+// Model (CC DC 0C): the model string is the first 7 bytes of the body, e.g.
+// "BL1850B", but packs differ in what they put there and after it, so only
+// an empty (all NUL) field is rejected. Blank frames and the ack are
+// checked by cmdAndReadCC().
+static uint8_t checkModel(const byte *rsp, uint8_t len) {
+    if (len < 7) return FRAME_RANGE;
+    for (int i = 0; i < 7; i++) {
+        if (rsp[i]) return FRAME_OK;
+    }
+    return FRAME_RANGE;
+}
+
+// Voltages (CC D7): cells up to 5 V, the pack within 1 V of their sum and
+// both thermistors within -40..150 C
+static uint8_t checkVoltages(const byte *rsp, uint8_t len) {
+    if (len < 18) return FRAME_RANGE;
+
+    uint32_t sum = 0;
+    for (int i = 0; i < 5; i++) {
+        uint16_t mv = le16(&rsp[2 + i*2]);
+        if (mv > 5000) return FRAME_RANGE;
+        sum += mv;
+    }
+
+    int32_t diff = (int32_t)le16(rsp) - (int32_t)sum;
+    if (diff > 1000 || diff < -1000) return FRAME_RANGE;
+
+    for (int i = 14; i <= 16; i += 2) {
+        int16_t centi = (int16_t)le16(&rsp[i]);
+        if (centi < -4000 || centi > 15000) return FRAME_RANGE;
+    }
+    return FRAME_OK;
+}
+
+// F0513 cell voltage (CC 31..35): up to 5 V
+static uint8_t checkCellF0513(const byte *rsp, uint8_t len) {
+    if (len < 2) return FRAME_RANGE;
+    return le16(rsp) > 5000 ? FRAME_RANGE : FRAME_OK;
+}
+
+bool sessionReadInfo() {
+    byte rsp[48];
+    byte cmd[] = {0xAA, 0x00};
+
+    bool success = cmdAndRead33(cmd, 2, rsp, 40, FRAME_INFO);
+
+    if (success) {
+        // Copy ROM ID
+        memcpy(batteryData.romId, rsp, 8);
+
+        // Parse message data (offset by 8 for ROM ID)
+        byte *msg = &rsp[8];
+
+        // Manufacturing date is in ROM ID bytes - use ISO 8601 (YYYY-MM-DD)
+        // romId[0] = year, romId[1] = month, romId[2] = day
+        snprintf(batteryData.mfgDate, sizeof(batteryData.mfgDate),
+                 "20%02d-%02d-%02d",
+                 batteryData.romId[0],   // year
+                 batteryData.romId[1],   // month
+                 batteryData.romId[2]);  // day
+
+        // Charge count, lock, error code and capacity (INFO_FIELDS)
+        decodeFrame<INFO_FIELDS>(msg, batteryData);
+
+        batteryData.valid = true;
+    } else {
+        batteryData.valid = false;
+    }
+
+    return success;
+}
+
+// Family of the pack in the current enable window. If no 0x33 exchange has
+// run yet but the cache holds entries, a bare 0x33 (ROM ID only) is cheaper
+// than guessing wrong. The ID goes through checkRom() like any other 0x33
+// frame; a rejected one is counted against kind and leaves the family
+// unknown.
+static uint8_t sessionFamily(uint8_t kind) {
+    if (!sessionPresent) return PROTO_UNKNOWN;
+
+    if (!sessionRomKnown) {
+        bool cached = false;
+        for (int i = 0; i < PROTO_CACHE_SLOTS; i++) {
+            if (protocolCache[i].family != PROTO_UNKNOWN) cached = true;
+        }
+        if (!cached) return PROTO_UNKNOWN;
+
+        byte rom[8];
+        const OneWireOp ops[] = {
+            {OW_OP_RESET, 0, 0},
+            {OW_OP_DELAY_US, 0, 310},
+            {OW_OP_WRITE_BYTE, 0x33, 0},
+            {OW_OP_READ, 8, 90},
+            {OW_OP_END, 0, 0}
+        };
+        busMetrics.resets++;
+        if (!busRun(ops, nullptr, rom)) return PROTO_UNKNOWN;
+
+        uint8_t result = checkRom(kind, rom);
+        if (result != FRAME_OK) {
+            frameReject(kind, result);
+            return PROTO_UNKNOWN;
+        }
+        memcpy(sessionRomId, rom, 8);
+        sessionRomKnown = true;
+    }
+    return protocolLookup(sessionRomId);
+}
+
+static void sessionRemember(uint8_t family) {
+    if (sessionRomKnown) protocolRemember(sessionRomId, family);
+}
+
+// The DC reply is a 16-byte body and the 0x06 ack. All 17 bytes are read,
+// so the ack can be checked and the pack has finished sending before the
+// next reset.
+#define MODEL_REPLY_LEN 17
+
+static bool readModelModern() {
+    byte rsp[MODEL_REPLY_LEN];
+    byte cmd[] = {0xDC, 0x0C};
+
+    if (!cmdAndReadCC(cmd, 2, rsp, MODEL_REPLY_LEN, FRAME_MODEL, checkModel)) return false;
+
+    // Copy model string (null-terminate, padding dropped)
+    memcpy(batteryData.model, rsp, 7);
+    batteryData.model[7] = '\0';
+    for (int i = 6; i > 0 && batteryData.model[i] == ' '; i--) {
+        batteryData.model[i] = '\0';
+    }
+    sessionRemember(PROTO_MODERN);
+    return true;
+}
+
+static bool readModelF0513() {
+    byte b[2];
+
+    if (!cmdAndReadF0513(0x31, b)) return false;
+
+    snprintf(batteryData.model, sizeof(batteryData.model), "BL%02X%02X", b[0], b[1]);
+    sessionRemember(PROTO_F0513);
+    return true;
+}
+
+bool sessionReadModel() {
+    uint8_t family = sessionFamily(FRAME_MODEL);
+
+    if (family == PROTO_F0513) {
+        if (readModelF0513()) return true;
+        sessionRemember(PROTO_UNKNOWN);     // stale entry, probe again
+        return readModelModern();
+    }
+
+    // A known modern pack that fails has a bad frame, not another protocol;
+    // cmdAndReadCC() has already retried it
+    if (family == PROTO_MODERN) return readModelModern();
+
+    // Unknown: modern path first, F0513 fallback for older batteries
+    return readModelModern() || readModelF0513();
+}
+
+static bool readVoltagesModern() {
+    byte rsp[32];
+    byte cmd[] = {0xD7, 0x00, 0x00, 0xFF};
+
+    if (!cmdAndReadCC(cmd, 4, rsp, 29, FRAME_VOLTAGES, checkVoltages)) return false;
+
+    // Pack, cells and temperatures (VOLTAGE_FIELDS)
+    decodeFrame<VOLTAGE_FIELDS>(rsp, batteryData);
+
+    uint16_t maxMv = 0, minMv = 0xFFFF;
+    for (int i = 0; i < 5; i++) {
+        uint16_t mv = batteryData.cellMv[i];
+        if (mv > maxMv) maxMv = mv;
+        if (mv < minMv) minMv = mv;
+    }
+    batteryData.cellDiffMv = maxMv - minMv;
+
+    sessionRemember(PROTO_MODERN);
+    return true;
+}
+
+static bool readVoltagesF0513() {
+    byte rsp[32];
+    byte vcmd[1];
+
+    for (int i = 0; i < 5; i++) {
+        vcmd[0] = 0x31 + i;
+        if (!cmdAndReadCC(vcmd, 1, rsp, 2, FRAME_F0513, checkCellF0513)) return false;
+        batteryData.cellMv[i] = le16(rsp);
+    }
+
+    // Calculate pack voltage and diff
+    uint16_t sum = 0, maxMv = 0, minMv = 0xFFFF;
+    for (int i = 0; i < 5; i++) {
+        uint16_t mv = batteryData.cellMv[i];
+        sum += mv;
+        if (mv > maxMv) maxMv = mv;
+        if (mv < minMv) minMv = mv;
+    }
+    batteryData.packMv = sum;
+    batteryData.cellDiffMv = maxMv - minMv;
+
+    // Temperature (F0513 only has cell temp, no MOSFET temp)
+    vcmd[0] = 0x52;
+    if (cmdAndReadCC(vcmd, 1, rsp, 2, FRAME_F0513)) {
+        batteryData.tempCellCentiC = (int16_t)le16(rsp);
+        batteryData.tempMosfetCentiC = 0;  // Not available on F0513
+    }
+
+    sessionRemember(PROTO_F0513);
+    return true;
+}
+
+static bool readVoltages() {
+    uint8_t family = sessionFamily(FRAME_VOLTAGES);
+
+    if (family == PROTO_F0513) {
+        if (readVoltagesF0513()) return true;
+        sessionRemember(PROTO_UNKNOWN);     // stale entry, probe again
+        return readVoltagesModern();
+    }
+
+    // No F0513 fallback for a known modern pack, as in sessionReadModel()
+    if (family == PROTO_MODERN) return readVoltagesModern();
+
+    // Unknown: modern path first, F0513 fallback for older batteries
+    return readVoltagesModern() || readVoltagesF0513();
+}
+
+// A failed read clears the measurements rather than leave an earlier
+// pack's values behind
+bool sessionReadVoltages() {
+    bool success = readVoltages();
+
+    batteryData.voltagesValid = success;
+    if (!success) {
+        batteryData.packMv = 0;
+        memset(batteryData.cellMv, 0, sizeof(batteryData.cellMv));
+        batteryData.cellDiffMv = 0;
+        batteryData.tempCellCentiC = 0;
+        batteryData.tempMosfetCentiC = 0;
+    }
+    return success;
+}
+
+// Read info (33 AA 00), model (CC DC 0C) and voltages (CC D7 00 00 FF) back
+// to back in the current enable window. Returns true if the info frame was
+// read. The bus task fills in settleMs and totalMs.
+bool sessionReadAll(ReadTiming *timing) {
+    uint32_t cycles = busMetrics.powerCycles;
+    uint32_t t = millis();
+    bool success = sessionReadInfo();
+    timing->infoMs = millis() - t;
+
+    t = millis();
+    sessionReadModel();
+    timing->modelMs = millis() - t;
+
+    t = millis();
+    sessionReadVoltages();
+    timing->voltagesMs = millis() - t;
+
+    timing->powerCycles = busMetrics.powerCycles - cycles;
+    return success;
+}
+
+// Enter test mode (33 D9 96 A5) and send DA <op>: 0x31/0x34 switch the LEDs
+// on/off, 0x04 clears the error code.
+bool sessionTestMode(byte op) {
+    byte cmd1[] = {0xD9, 0x96, 0xA5};
+    byte rsp[32];
+    if (!cmdAndRead33(cmd1, 3, rsp, 9)) return false;
+
+    byte cmd2[] = {0xDA, op};
+    return cmdAndRead33(cmd2, 2, rsp, 9);
+}
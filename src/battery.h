@@ -0,0 +1,299 @@
+/**
+ * Makita battery protocol - shared definitions
+ *
+ * Pin configuration, the OneWire master instance and the BatteryData model
+ * used by both the firmware (main.cpp) and the host simulation (sim/).
+ */
+
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include "OneWire2.h"
+#if ONEWIRE_RMT
+#include "OneWireRMT.h"
+#endif
+
+// Pin definitions (can be overridden via build flags)
+#ifndef ONEWIRE_PIN
+#define ONEWIRE_PIN 3
+#endif
+
+#ifndef ENABLE_PIN
+#define ENABLE_PIN 4
+#endif
+
+// Adaptive wake-up: after raising enable, poll for a presence pulse with a
+// growing backoff instead of sleeping a fixed 400 ms. Set WAKE_ADAPTIVE=0 to
+// restore the fixed delay.
+#ifndef WAKE_ADAPTIVE
+#define WAKE_ADAPTIVE 1
+#endif
+
+#ifndef WAKE_DEADLINE_MS
+#define WAKE_DEADLINE_MS 600
+#endif
+
+// Presence probe: each enable window first waits up to WAKE_DEADLINE_MS for
+// a presence pulse. Once a probe has found no pack, the result is cached
+// until an edge on the data line, or for at most PRESENCE_CACHE_MS, and
+// later probes only wait PRESENCE_PROBE_MS (longer if a known pack has been
+// seen to wake slower) until the next edge.
+#ifndef PRESENCE_PROBE_MS
+#define PRESENCE_PROBE_MS 100
+#endif
+
+#ifndef PRESENCE_CACHE_MS
+#define PRESENCE_CACHE_MS 5000
+#endif
+
+#define WAKE_BACKOFF_MIN_MS 2
+#define WAKE_BACKOFF_MAX_MS 50
+#define WAKE_STATS_SLOTS 4
+
+// Protocol family cache: remembers per ROM ID whether a pack answers the
+// CC DC / CC D7 commands or only the F0513 ones, so later reads go straight
+// to the working path. -DPROTO_CACHE_NVS=1 keeps it across reboots.
+#ifndef PROTO_CACHE_SLOTS
+#define PROTO_CACHE_SLOTS 8
+#endif
+
+#ifndef PROTO_CACHE_NVS
+#define PROTO_CACHE_NVS 0
+#endif
+
+// Minimum time between NVS writes of the cache; changes in between are
+// saved at the end of a later enable window
+#ifndef PROTO_CACHE_SAVE_MS
+#define PROTO_CACHE_SAVE_MS 60000
+#endif
+
+// Frame validation: exchanges retry up to FRAME_RETRIES times. The ROM ID
+// CRC and the trailing 0x06 ack are counted but only enforced with
+// -DFRAME_STRICT=1, since not every pack is known to send them.
+#ifndef FRAME_RETRIES
+#define FRAME_RETRIES 3
+#endif
+
+#ifndef FRAME_STRICT
+#define FRAME_STRICT 0
+#endif
+
+// Nibble swap helper (Makita.h has its own when the emulator is linked in)
+#ifndef SWAP_NIBBLES
+#define SWAP_NIBBLES(x) (((x) & 0x0F) << 4 | ((x) & 0xF0) >> 4)
+#endif
+
+// Instantiate OneWire with template pin. -DONEWIRE_RMT=1 swaps the
+// bit-banged master for the RMT peripheral backend.
+#if ONEWIRE_RMT
+typedef OneWireRMT<ONEWIRE_PIN> BusWire;
+#else
+typedef OneWire<ONEWIRE_PIN> BusWire;
+#endif
+
+extern BusWire makita;
+extern OneWireEngine<BusWire> busEngine;
+
+// Battery data structure. Measurements are kept as the integers the pack
+// reports (the C3 has no FPU); conversion to volts and degrees is left to
+// whoever presents them.
+struct BatteryData {
+    bool valid;                 // the last info read succeeded
+    bool voltagesValid;         // the last voltage read succeeded
+    char model[16];
+    bool locked;
+    uint16_t chargeCount;
+    char mfgDate[16];
+    uint8_t capacityDeciAh;     // tenths of an Ah
+    uint8_t errorCode;
+    uint8_t romId[8];
+    uint16_t packMv;
+    uint16_t cellMv[5];
+    uint16_t cellDiffMv;
+    int16_t tempCellCentiC;     // hundredths of a degree Celsius
+    int16_t tempMosfetCentiC;
+};
+
+extern BatteryData batteryData;
+
+// Per-stage timing of a batched read session (milliseconds), and the power
+// cycles it took: each one hides ~200 ms plus a wake inside a stage
+struct ReadTiming {
+    uint32_t settleMs;
+    uint32_t infoMs;
+    uint32_t modelMs;
+    uint32_t voltagesMs;
+    uint32_t totalMs;
+    uint32_t powerCycles;
+};
+
+// Observed wake latency per battery, keyed by ROM ID
+struct WakeStats {
+    uint8_t romId[8];
+    uint16_t samples;
+    uint16_t lastMs;
+    uint16_t minMs;
+    uint16_t maxMs;
+};
+
+extern WakeStats wakeStats[WAKE_STATS_SLOTS];
+
+enum ProtocolFamily {
+    PROTO_UNKNOWN = 0,
+    PROTO_MODERN,       // CC DC 0C model, CC D7 voltages
+    PROTO_F0513         // CC 99 model, CC 31..35 / 52 voltages
+};
+
+struct ProtocolCacheEntry {
+    uint8_t romId[8];
+    uint8_t family;     // ProtocolFamily, PROTO_UNKNOWN if the slot is free
+    uint32_t lastUsed;
+};
+
+extern ProtocolCacheEntry protocolCache[PROTO_CACHE_SLOTS];
+
+// Frame kinds validation outcomes are counted under
+enum FrameKind {
+    FRAME_INFO,         // 33 AA 00
+    FRAME_MODEL,        // CC DC 0C
+    FRAME_VOLTAGES,     // CC D7 00 00 FF
+    FRAME_F0513,        // CC 31..35 / 52 after CC 99
+    FRAME_RAW,          // bridge and test mode exchanges
+    FRAME_KINDS
+};
+
+enum FrameResult {
+    FRAME_OK = 0,
+    FRAME_BLANK,        // all 0xFF: nobody answered
+    FRAME_ROM_MISMATCH, // ROM ID differs from the one seen in this session
+    FRAME_BAD_CRC,      // ROM ID CRC8 (strict mode)
+    FRAME_NO_ACK,       // no trailing 0x06 (strict mode)
+    FRAME_RANGE         // decoded values out of range
+};
+
+struct FrameStats {
+    uint32_t ok;
+    uint32_t retries;       // attempts after the first
+    uint32_t failures;      // gave up after FRAME_RETRIES
+    uint32_t noPresence;
+    uint32_t blank;
+    uint32_t romMismatch;
+    uint32_t badCrc;        // counted in every mode
+    uint32_t noAck;         // counted in every mode
+    uint32_t range;
+    uint32_t lastErrorMs;   // millis() of the last rejected attempt
+};
+
+extern FrameStats frameStats[FRAME_KINDS];
+
+// Bus metrics: counters plus a fixed-bucket latency histogram per opcode,
+// recorded by the command functions on the bus task
+#define LATENCY_BUCKETS 9       // see latencyBoundsMs; the last is +inf
+
+enum BusOpcode {
+    BUS_OP_33,          // cmdAndRead33
+    BUS_OP_CC,          // cmdAndReadCC
+    BUS_OP_F0513,       // cmdAndReadF0513
+    BUS_OPS
+};
+
+struct LatencyHistogram {
+    uint32_t count;
+    uint32_t totalMs;
+    uint32_t maxMs;
+    uint32_t buckets[LATENCY_BUCKETS];
+};
+
+struct BusMetrics {
+    uint32_t resets;        // reset pulses sent by exchanges
+    uint32_t noPresence;    // of which nobody answered
+    uint32_t powerCycles;   // triggerPower()
+    uint32_t retries;       // exchange attempts after the first
+    uint32_t wakePolls;     // presence polls while waking
+    uint32_t wakeTimeouts;  // wakes that gave up
+    LatencyHistogram latency[BUS_OPS];
+};
+
+extern BusMetrics busMetrics;
+extern const uint16_t latencyBoundsMs[LATENCY_BUCKETS - 1];
+
+// Payload check for one frame kind; rsp excludes the ROM ID
+typedef uint8_t (*FrameCheck)(const byte *rsp, uint8_t len);
+extern uint32_t sessionSettleMs;
+extern bool sessionPresent;
+
+// Enable window
+void setEnable(bool high);
+void triggerPower();
+bool wakeBattery(uint32_t deadlineMs, uint32_t *latencyMs);
+void recordWakeLatency(const uint8_t *romId);
+bool beginSession();
+void endSession();
+
+// Protocol family cache
+void protocolCacheLoad();
+void protocolCacheFlush();
+uint8_t protocolLookup(const uint8_t *romId);
+uint8_t protocolPeek(const uint8_t *romId);
+void protocolRemember(const uint8_t *romId, uint8_t family);
+const char *protocolName(uint8_t family);
+
+// Bus transfers
+void busYield();
+void busSleep(uint32_t ms);
+bool busRun(const OneWireOp *ops, const byte *tx, byte *rx);
+bool cmdAndRead33(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len,
+                  uint8_t kind = FRAME_RAW, FrameCheck check = nullptr);
+bool cmdAndReadCC(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len,
+                  uint8_t kind = FRAME_RAW, FrameCheck check = nullptr);
+uint8_t onewireCrc8(const uint8_t *data, uint8_t len);
+const char *busOpcodeName(uint8_t op);
+size_t busMetricsEncode(byte *buf, size_t max);
+const char *frameKindName(uint8_t kind);
+bool cmdAndReadF0513(byte cmd, byte *rsp);
+
+// Bridge scripts (bridge opcode 0x53). A script is a sequence of steps,
+// each a code byte followed by its operands. The codes are wire protocol
+// and fixed here; busScript() maps each one onto the engine's OW_OP_* step
+// explicitly, so the engine enum can change without changing the bridge:
+//   SCRIPT_RESET                  reset; stops the script if nobody answers
+//   SCRIPT_RESET_ANY              reset, presence ignored
+//   SCRIPT_WRITE_BYTE b           write b
+//   SCRIPT_WRITE n b1..bn         write n bytes
+//   SCRIPT_READ n                 read n bytes into the response
+//   SCRIPT_DELAY_US lo hi         busy wait
+//   SCRIPT_SLEEP_MS lo hi         yield
+//   SCRIPT_SKIP_IF_FF n           skip the next n script bytes if the
+//                                 last read returned nothing but 0xFF
+//   SCRIPT_END                    optional; the script also ends with its bytes
+// The output is [status][stop offset][bytes read...].
+#define SCRIPT_END          0x00
+#define SCRIPT_RESET        0x01
+#define SCRIPT_RESET_ANY    0x02
+#define SCRIPT_WRITE_BYTE   0x03
+#define SCRIPT_WRITE        0x04
+#define SCRIPT_READ         0x05
+#define SCRIPT_DELAY_US     0x06
+#define SCRIPT_SLEEP_MS     0x07
+#define SCRIPT_SKIP_IF_FF   0x10
+
+#define SCRIPT_BYTE_GAP_US  90      // before each byte of WRITE and READ, as in the exchanges
+
+enum ScriptStatus {
+    SCRIPT_OK = 0,
+    SCRIPT_NO_PRESENCE,     // a RESET went unanswered, or no pack in the window
+    SCRIPT_MALFORMED,       // unknown code or truncated operands
+    SCRIPT_FULL,            // a READ would not fit the response
+    SCRIPT_BUSY             // not run: the bus queue was full
+};
+
+uint8_t busScript(const byte *script, uint8_t len, byte *out, uint8_t max);
+
+// High-level reads; the session* functions assume the enable window is open
+bool sessionReadInfo();
+bool sessionReadModel();
+bool sessionReadVoltages();
+bool sessionReadAll(ReadTiming *timing);
+bool sessionTestMode(byte op);
+
+#endif // BATTERY_H
@@ -0,0 +1,47 @@
+/**
+ * BatteryData as CBOR, via CborWriter
+ *
+ * The same members as battery_json.h, except that measurements stay
+ * integers: millivolts, centidegrees Celsius and mAh, straight from
+ * BatteryData. Keys carry the unit so that decoders need no schema.
+ */
+
+#ifndef BATTERY_CBOR_H
+#define BATTERY_CBOR_H
+
+#include "battery.h"
+#include "cbor_writer.h"
+
+inline void cborBatteryInfo(CborWriter &w, const BatteryData &data) {
+    w.add("model", data.model);
+    w.add("locked", data.locked);
+    w.add("chargeCount", (uint32_t)data.chargeCount);
+    w.add("mfgDate", data.mfgDate);
+    w.add("capacityMah", (uint32_t)data.capacityDeciAh * 100);
+    w.add("errorCode", (uint32_t)data.errorCode);
+}
+
+inline void cborBatteryVoltages(CborWriter &w, const BatteryData &data) {
+    w.add("packMv", (uint32_t)data.packMv);
+    w.beginArray("cellMv");
+    for (int i = 0; i < 5; i++) {
+        w.add((uint32_t)data.cellMv[i]);
+    }
+    w.endArray();
+    w.add("cellDiffMv", (uint32_t)data.cellDiffMv);
+    w.add("tempCellCentiC", (int32_t)data.tempCellCentiC);
+    w.add("tempMosfetCentiC", (int32_t)data.tempMosfetCentiC);
+}
+
+inline void cborReadTiming(CborWriter &w, const ReadTiming &timing) {
+    w.beginMap("timing");
+    w.add("settleMs", timing.settleMs);
+    w.add("infoMs", timing.infoMs);
+    w.add("modelMs", timing.modelMs);
+    w.add("voltagesMs", timing.voltagesMs);
+    w.add("totalMs", timing.totalMs);
+    w.add("powerCycles", timing.powerCycles);
+    w.endMap();
+}
+
+#endif // BATTERY_CBOR_H
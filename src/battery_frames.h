@@ -0,0 +1,141 @@
+/**
+ * Makita battery frames - field descriptors
+ *
+ * Each payload field is described once (offset, width, byte order, nibble
+ * swap, mask, scale and the BatteryData member it lands in), and
+ * decodeFrame<Table>() expands a table into straight-line code at compile
+ * time: every descriptor is a constant, so each field compiles to a load,
+ * a shift and a store, with no loop and no branch on the flags.
+ *
+ * To decode a new field, add a FIELD() line to the table. The
+ * static_asserts at the end decode a captured frame at compile time, so a
+ * wrong descriptor breaks the build rather than the readings.
+ */
+
+#ifndef BATTERY_FRAMES_H
+#define BATTERY_FRAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include "battery.h"
+
+#define FIELD_LE        0x00
+#define FIELD_BE        0x01    // most significant byte first
+#define FIELD_NIBBLES   0x02    // each byte nibble-swapped (SWAP_NIBBLES)
+#define FIELD_SIGNED    0x04    // two's complement of the field width
+#define FIELD_BOOL      0x08    // stored as value != 0
+
+struct FrameField {
+    uint8_t offset;     // in the payload (after the ROM ID for 0x33)
+    uint8_t width;      // 1 or 2 bytes
+    uint8_t flags;      // FIELD_*
+    uint16_t mask;      // applied to the assembled value
+    int16_t scale;      // multiplier into the stored unit
+    uint8_t dest;       // offsetof the BatteryData member
+    uint8_t destSize;   // sizeof the BatteryData member
+};
+
+#define FIELD(offset, width, flags, mask, scale, member) \
+    { offset, width, flags, mask, scale, offsetof(BatteryData, member), sizeof(BatteryData::member) }
+
+// 0x33 AA 00 reply, offsets after the 8-byte ROM ID
+static constexpr FrameField INFO_FIELDS[] = {
+    FIELD(28, 2, FIELD_BE | FIELD_NIBBLES, 0x0FFF, 1, chargeCount),
+    FIELD(22, 1, FIELD_BOOL,               0x000F, 1, locked),
+    FIELD(21, 1, 0,                        0x000F, 1, errorCode),
+    FIELD(18, 1, FIELD_NIBBLES,            0x00FF, 1, capacityDeciAh),
+};
+
+// CC D7 00 00 FF reply; cellDiffMv is derived, not read
+static constexpr FrameField VOLTAGE_FIELDS[] = {
+    FIELD( 0, 2, FIELD_LE,     0xFFFF, 1, packMv),
+    FIELD( 2, 2, FIELD_LE,     0xFFFF, 1, cellMv[0]),
+    FIELD( 4, 2, FIELD_LE,     0xFFFF, 1, cellMv[1]),
+    FIELD( 6, 2, FIELD_LE,     0xFFFF, 1, cellMv[2]),
+    FIELD( 8, 2, FIELD_LE,     0xFFFF, 1, cellMv[3]),
+    FIELD(10, 2, FIELD_LE,     0xFFFF, 1, cellMv[4]),
+    FIELD(14, 2, FIELD_SIGNED, 0xFFFF, 1, tempCellCentiC),
+    FIELD(16, 2, FIELD_SIGNED, 0xFFFF, 1, tempMosfetCentiC),
+};
+
+template <uint8_t Flags>
+constexpr uint8_t fieldByte(uint8_t b) {
+    return (Flags & FIELD_NIBBLES) ? (uint8_t)((b & 0x0F) << 4 | (b & 0xF0) >> 4) : b;
+}
+
+// Value of field I of Table, scaled
+template <const auto &Table, size_t I>
+constexpr int32_t fieldValue(const uint8_t *payload) {
+    constexpr FrameField F = Table[I];
+    static_assert(F.width == 1 || F.width == 2, "fields are 1 or 2 bytes");
+
+    uint16_t lo = fieldByte<F.flags>(payload[F.offset]);
+    uint16_t hi = F.width == 2 ? fieldByte<F.flags>(payload[F.offset + 1]) : 0;
+    uint16_t raw = (F.flags & FIELD_BE) && F.width == 2 ? (lo << 8 | hi) : (hi << 8 | lo);
+    raw &= F.mask;
+
+    int32_t value = raw;
+    if constexpr (F.flags & FIELD_SIGNED) {
+        value = F.width == 2 ? (int32_t)(int16_t)raw : (int32_t)(int8_t)raw;
+    }
+    if constexpr (F.flags & FIELD_BOOL) return value != 0;
+    return value * F.scale;
+}
+
+template <const auto &Table, size_t I>
+inline void fieldStore(const uint8_t *payload, BatteryData &out) {
+    constexpr FrameField F = Table[I];
+    static_assert(F.destSize == 1 || F.destSize == 2, "members are 1 or 2 bytes");
+
+    int32_t value = fieldValue<Table, I>(payload);
+    uint8_t *dest = (uint8_t *)&out + F.dest;
+    if constexpr (F.destSize == 1) {
+        uint8_t v = value;
+        memcpy(dest, &v, 1);
+    } else {
+        uint16_t v = value;
+        memcpy(dest, &v, 2);
+    }
+}
+
+template <const auto &Table, size_t... I>
+inline void decodeFields(const uint8_t *payload, BatteryData &out, std::index_sequence<I...>) {
+    (fieldStore<Table, I>(payload, out), ...);
+}
+
+// Decode every field of Table from payload into out
+template <const auto &Table>
+inline void decodeFrame(const uint8_t *payload, BatteryData &out) {
+    decodeFields<Table>(payload, out, std::make_index_sequence<sizeof(Table) / sizeof(Table[0])>());
+}
+
+// ------------------------------------------------------------------
+// Compile-time checks against captured frames
+// ------------------------------------------------------------------
+
+// 0x33 payload of a locked BL1850B with error 6, 5.0 Ah and 297 charges
+static constexpr uint8_t INFO_SAMPLE[32] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0x23, 0, 0, 0x06, 0x01, 0, 0, 0, 0, 0, 0x10, 0x92, 0, 0,
+};
+
+static_assert(fieldValue<INFO_FIELDS, 0>(INFO_SAMPLE) == 297, "charge count");
+static_assert(fieldValue<INFO_FIELDS, 1>(INFO_SAMPLE) == 1, "lock");
+static_assert(fieldValue<INFO_FIELDS, 2>(INFO_SAMPLE) == 6, "error code");
+static_assert(fieldValue<INFO_FIELDS, 3>(INFO_SAMPLE) == 50, "capacity");
+
+// D7 payload: 16.520 V pack, 3304..3308 mV cells, 29.50 C and -12.25 C
+static constexpr uint8_t VOLTAGE_SAMPLE[29] = {
+    0x88, 0x40, 0xE8, 0x0C, 0xE9, 0x0C, 0xEA, 0x0C, 0xEB, 0x0C, 0xEC, 0x0C,
+    0, 0, 0x86, 0x0B, 0x37, 0xFB,
+};
+
+static_assert(fieldValue<VOLTAGE_FIELDS, 0>(VOLTAGE_SAMPLE) == 16520, "pack");
+static_assert(fieldValue<VOLTAGE_FIELDS, 1>(VOLTAGE_SAMPLE) == 3304, "cell 1");
+static_assert(fieldValue<VOLTAGE_FIELDS, 5>(VOLTAGE_SAMPLE) == 3308, "cell 5");
+static_assert(fieldValue<VOLTAGE_FIELDS, 6>(VOLTAGE_SAMPLE) == 2950, "cell temperature");
+static_assert(fieldValue<VOLTAGE_FIELDS, 7>(VOLTAGE_SAMPLE) == -1225, "MOSFET temperature");
+
+#endif // BATTERY_FRAMES_H
@@ -0,0 +1,47 @@
+/**
+ * BatteryData as JSON, via JsonWriter
+ *
+ * The members the read endpoints and the event stream have in common.
+ * BatteryData's integer fields are written as volts, degrees and Ah with
+ * the decimals of their resolution, without going through float.
+ */
+
+#ifndef BATTERY_JSON_H
+#define BATTERY_JSON_H
+
+#include "battery.h"
+#include "json_writer.h"
+
+inline void jsonBatteryInfo(JsonWriter &w, const BatteryData &data) {
+    w.add("model", data.model);
+    w.add("locked", data.locked);
+    w.add("chargeCount", (uint32_t)data.chargeCount);
+    w.add("mfgDate", data.mfgDate);
+    w.addFixed("capacity", data.capacityDeciAh, 1);
+    w.add("errorCode", (uint32_t)data.errorCode);
+}
+
+inline void jsonBatteryVoltages(JsonWriter &w, const BatteryData &data) {
+    static const char *const cells[5] = { "cell1", "cell2", "cell3", "cell4", "cell5" };
+
+    w.addFixed("packVoltage", data.packMv, 3);
+    for (int i = 0; i < 5; i++) {
+        w.addFixed(cells[i], data.cellMv[i], 3);
+    }
+    w.addFixed("cellDiff", data.cellDiffMv, 3);
+    w.addFixed("tempCell", data.tempCellCentiC, 2);
+    w.addFixed("tempMosfet", data.tempMosfetCentiC, 2);
+}
+
+inline void jsonReadTiming(JsonWriter &w, const ReadTiming &timing) {
+    w.beginObject("timing");
+    w.add("settleMs", timing.settleMs);
+    w.add("infoMs", timing.infoMs);
+    w.add("modelMs", timing.modelMs);
+    w.add("voltagesMs", timing.voltagesMs);
+    w.add("totalMs", timing.totalMs);
+    w.add("powerCycles", timing.powerCycles);
+    w.endObject();
+}
+
+#endif // BATTERY_JSON_H
@@ -0,0 +1,120 @@
+/**
+ * OBI ESP32 - frame decoder benchmark (host)
+ *
+ * Decodes the same 0x33 info and D7 voltage payloads two ways, checks
+ * that they agree, and reports time per frame:
+ *
+ *   handwritten  the per-field parsing battery.cpp used before
+ *                battery_frames.h
+ *   descriptors  decodeFrame<INFO_FIELDS> / decodeFrame<VOLTAGE_FIELDS>
+ *
+ *   pio run -e native_bench_frames && .pio/build/native_bench_frames/program [iterations]
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "battery_frames.h"
+
+#define SWAP_BYTE(b) ((uint8_t)(((b) & 0x0F) << 4 | ((b) & 0xF0) >> 4))
+
+// ------------------------------------------------------------------
+// Decoders
+// ------------------------------------------------------------------
+
+static uint16_t le16(const uint8_t *p) {
+    return (uint16_t)p[0] | (uint16_t)p[1] << 8;
+}
+
+static void handInfo(const uint8_t *msg, BatteryData &out) {
+    uint16_t rawCount = ((uint16_t)SWAP_BYTE(msg[29])) |
+                       (((uint16_t)SWAP_BYTE(msg[28])) << 8);
+    out.chargeCount = rawCount & 0x0FFF;
+    out.locked = (msg[22] & 0x0F) > 0;
+    out.errorCode = msg[21] & 0x0F;
+    out.capacityDeciAh = SWAP_BYTE(msg[18]);
+}
+
+static void handVoltages(const uint8_t *rsp, BatteryData &out) {
+    out.packMv = le16(rsp);
+    for (int i = 0; i < 5; i++) {
+        out.cellMv[i] = le16(&rsp[2 + i*2]);
+    }
+    out.tempCellCentiC = (int16_t)le16(&rsp[14]);
+    out.tempMosfetCentiC = (int16_t)le16(&rsp[16]);
+}
+
+static void descInfo(const uint8_t *msg, BatteryData &out) {
+    decodeFrame<INFO_FIELDS>(msg, out);
+}
+
+static void descVoltages(const uint8_t *rsp, BatteryData &out) {
+    decodeFrame<VOLTAGE_FIELDS>(rsp, out);
+}
+
+static bool sameFields(const BatteryData &a, const BatteryData &b) {
+    return a.chargeCount == b.chargeCount && a.locked == b.locked &&
+           a.errorCode == b.errorCode && a.capacityDeciAh == b.capacityDeciAh &&
+           a.packMv == b.packMv && !memcmp(a.cellMv, b.cellMv, sizeof(a.cellMv)) &&
+           a.tempCellCentiC == b.tempCellCentiC && a.tempMosfetCentiC == b.tempMosfetCentiC;
+}
+
+// ------------------------------------------------------------------
+// Main
+// ------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+#define FRAMES 64
+
+static uint8_t infoFrames[FRAMES][32];
+static uint8_t voltageFrames[FRAMES][32];
+
+typedef void (*Decoder)(const uint8_t *, BatteryData &);
+
+static uint32_t run(const char *name, Decoder info, Decoder voltages, int iterations) {
+    BatteryData out = {};
+    uint32_t sink = 0;
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        int f = i % FRAMES;
+        info(infoFrames[f], out);
+        voltages(voltageFrames[f], out);
+        sink += out.chargeCount + out.packMv + out.cellMv[4] + out.tempMosfetCentiC;
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    printf("%-12s %8.1f ns/frame pair\n", name, ns);
+    return sink;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 10000000;
+    if (iterations < 1) iterations = 1;
+
+    srand(1);
+    for (int f = 0; f < FRAMES; f++) {
+        for (int i = 0; i < 32; i++) {
+            infoFrames[f][i] = rand();
+            voltageFrames[f][i] = rand();
+        }
+    }
+
+    for (int f = 0; f < FRAMES; f++) {
+        BatteryData a = {}, b = {};
+        handInfo(infoFrames[f], a);
+        handVoltages(voltageFrames[f], a);
+        descInfo(infoFrames[f], b);
+        descVoltages(voltageFrames[f], b);
+        if (!sameFields(a, b)) {
+            printf("MISMATCH on frame %d\n", f);
+            return 1;
+        }
+    }
+    printf("%d random frames decode identically\n\n", FRAMES);
+
+    uint32_t a = run("handwritten", handInfo, handVoltages, iterations);
+    uint32_t b = run("descriptors", descInfo, descVoltages, iterations);
+    return a == b ? 0 : 1;
+}
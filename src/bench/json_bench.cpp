@@ -0,0 +1,172 @@
+/**
+ * OBI ESP32 - JSON benchmark (host)
+ *
+ * Renders the /api/read body for the same BatteryData two ways and reports
+ * time and heap allocations per response:
+ *
+ *   arduinojson  JsonDocument + serializeJson into a string, as the
+ *                handlers did before JsonWriter
+ *   jsonwriter   JsonWriter into a fixed buffer (battery_json.h)
+ *
+ *   pio run -e native_bench && .pio/build/native_bench/program [iterations]
+ *
+ * Absolute times are the host's; the allocation counts carry over to the
+ * target as they are.
+ */
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <ArduinoJson.h>
+#include "battery_json.h"
+
+// ------------------------------------------------------------------
+// Allocation counting
+// ------------------------------------------------------------------
+
+static size_t allocations;
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// ArduinoJson allocates through its own interface rather than new
+class CountingAllocator : public ArduinoJson::Allocator {
+public:
+    void *allocate(size_t size) override {
+        allocations++;
+        return malloc(size);
+    }
+    void deallocate(void *p) override { free(p); }
+    void *reallocate(void *p, size_t size) override {
+        allocations++;
+        return realloc(p, size);
+    }
+};
+
+static CountingAllocator countingAllocator;
+
+// ------------------------------------------------------------------
+// Renderers
+// ------------------------------------------------------------------
+
+static BatteryData data;
+static ReadTiming timing;
+
+static size_t renderArduinoJson(std::string &out) {
+    JsonDocument doc(&countingAllocator);
+    doc["success"] = data.valid;
+    doc["present"] = true;
+    doc["fresh"] = false;
+    doc["ageMs"] = 1830;
+    doc["model"] = data.model;
+    doc["locked"] = data.locked;
+    doc["chargeCount"] = data.chargeCount;
+    doc["mfgDate"] = data.mfgDate;
+    doc["capacity"] = data.capacityDeciAh / 10.0f;
+    doc["errorCode"] = data.errorCode;
+    doc["packVoltage"] = data.packMv / 1000.0f;
+    doc["cell1"] = data.cellMv[0] / 1000.0f;
+    doc["cell2"] = data.cellMv[1] / 1000.0f;
+    doc["cell3"] = data.cellMv[2] / 1000.0f;
+    doc["cell4"] = data.cellMv[3] / 1000.0f;
+    doc["cell5"] = data.cellMv[4] / 1000.0f;
+    doc["cellDiff"] = data.cellDiffMv / 1000.0f;
+    doc["tempCell"] = data.tempCellCentiC / 100.0f;
+    doc["tempMosfet"] = data.tempMosfetCentiC / 100.0f;
+    doc["protocol"] = "modern";
+
+    JsonObject t = doc["timing"].to<JsonObject>();
+    t["settleMs"] = timing.settleMs;
+    t["infoMs"] = timing.infoMs;
+    t["modelMs"] = timing.modelMs;
+    t["voltagesMs"] = timing.voltagesMs;
+    t["totalMs"] = timing.totalMs;
+    t["powerCycles"] = timing.powerCycles;
+
+    out.clear();
+    serializeJson(doc, out);
+    return out.size();
+}
+
+static size_t renderJsonWriter(char *buf, size_t size) {
+    JsonWriter w(buf, size);
+    w.beginObject();
+    w.add("success", data.valid);
+    w.add("present", true);
+    w.add("fresh", false);
+    w.add("ageMs", (uint32_t)1830);
+    jsonBatteryInfo(w, data);
+    jsonBatteryVoltages(w, data);
+    w.add("protocol", "modern");
+    jsonReadTiming(w, timing);
+    w.endObject();
+    w.c_str();
+    return w.overflow() ? 0 : w.length();
+}
+
+// ------------------------------------------------------------------
+// Main
+// ------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+static void report(const char *name, Clock::duration elapsed, size_t allocs, int iterations, size_t bytes) {
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    printf("%-12s %8.0f ns/op %6.2f allocs/op %4zu bytes\n",
+           name, ns, (double)allocs / iterations, bytes);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    if (iterations < 1) iterations = 1;
+
+    data.valid = true;
+    snprintf(data.model, sizeof(data.model), "BL1850B");
+    snprintf(data.mfgDate, sizeof(data.mfgDate), "2021-06");
+    data.chargeCount = 42;
+    data.capacityDeciAh = 50;
+    data.errorCode = 6;
+    data.packMv = 16520;
+    data.cellMv[0] = 3304;
+    data.cellMv[1] = 3305;
+    data.cellMv[2] = 3303;
+    data.cellMv[3] = 3304;
+    data.cellMv[4] = 3304;
+    data.cellDiffMv = 2;
+    data.tempCellCentiC = 2950;
+    data.tempMosfetCentiC = 2825;
+    timing = { 400, 41, 12, 26, 479 };
+
+    std::string out;
+    static char buf[768];
+    size_t bytes;
+
+    allocations = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        std::string response;   // a fresh String per request, as in the handlers
+        bytes = renderArduinoJson(response);
+    }
+    report("arduinojson", Clock::now() - start, allocations, iterations, bytes);
+
+    allocations = 0;
+    start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        bytes = renderJsonWriter(buf, sizeof(buf));
+    }
+    report("jsonwriter", Clock::now() - start, allocations, iterations, bytes);
+
+    renderArduinoJson(out);
+    renderJsonWriter(buf, sizeof(buf));
+    printf("\narduinojson: %s\njsonwriter:  %s\n", out.c_str(), buf);
+    return 0;
+}
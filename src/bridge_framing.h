@@ -0,0 +1,63 @@
+/**
+ * Serial bridge response framing
+ *
+ * BRIDGE_FRAMING_RAW is the original [cmd][rsp_len][data...] response.
+ * BRIDGE_FRAMING_COBS appends a CRC-16/CCITT-FALSE of those bytes (low
+ * byte first), COBS-encodes the result and ends it with a 0x00 delimiter.
+ * The encoded frame contains no other zero, so after a corrupted or lost
+ * frame a host skips to the next 0x00 and carries on.
+ *
+ * A host selects the framing in the 0x01 version request (see main.cpp).
+ */
+
+#ifndef BRIDGE_FRAMING_H
+#define BRIDGE_FRAMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BRIDGE_FRAMING_RAW      0
+#define BRIDGE_FRAMING_COBS     1
+
+// Worst case for len payload bytes: the CRC, one code byte per 254 bytes
+// and the delimiter
+#define BRIDGE_COBS_MAX(len)    ((len) + 2 + ((len) + 2) / 254 + 1 + 1)
+
+// CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF, no reflection
+inline uint16_t bridgeCrc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// COBS-encodes in[0..len) plus its CRC into out, followed by the 0x00
+// delimiter. out must hold BRIDGE_COBS_MAX(len) bytes. Returns the length
+// written.
+inline size_t bridgeCobsFrame(const uint8_t *in, size_t len, uint8_t *out) {
+    uint16_t crc = bridgeCrc16(in, len);
+    size_t code = 0;        // position of the current block's code byte
+    size_t n = 1;
+    uint8_t run = 1;
+
+    for (size_t i = 0; i < len + 2; i++) {
+        uint8_t b = i < len ? in[i] : (i == len ? crc & 0xFF : crc >> 8);
+        if (b) {
+            out[n++] = b;
+            run++;
+        }
+        if (!b || run == 0xFF) {
+            out[code] = run;
+            code = n++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    out[n++] = 0x00;
+    return n;
+}
+
+#endif // BRIDGE_FRAMING_H
@@ -0,0 +1,119 @@
+/**
+ * Serial bridge frame parser
+ *
+ * Host frames are [0x01][data_len][rsp_len][cmd][data...]. Bytes go into a
+ * ring with push() as they arrive, and poll() hands out complete frames
+ * without ever waiting for more input. A frame must complete within
+ * BRIDGE_FRAME_TIMEOUT_MS of its start byte; if it does not, that start
+ * byte is dropped and the parser resynchronises on the next 0x01 already
+ * in the ring, so a truncated frame costs one timeout rather than the
+ * bridge.
+ *
+ * push() and poll() may run in different tasks (e.g. the USB CDC RX
+ * callback and loop()), one producer and one consumer.
+ */
+
+#ifndef BRIDGE_PARSER_H
+#define BRIDGE_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BRIDGE_START            0x01
+#define BRIDGE_HEADER_LEN       4
+#define BRIDGE_RING_SIZE        512     // power of two, holds a full frame
+
+#ifndef BRIDGE_FRAME_TIMEOUT_MS
+#define BRIDGE_FRAME_TIMEOUT_MS 100
+#endif
+
+struct BridgeFrame {
+    uint8_t len;
+    uint8_t rspLen;
+    uint8_t cmd;
+    uint8_t data[255];
+};
+
+class BridgeParser {
+public:
+    BridgeParser() : frames(0), timeouts(0), discarded(0), overruns(0),
+                     m_head(0), m_tail(0), m_inFrame(false), m_startMs(0) {}
+
+    // Producer side. Returns false (and counts an overrun) if the ring is full.
+    bool push(uint8_t b) {
+        uint16_t head = m_head;
+        if ((uint16_t)(head - m_tail) >= BRIDGE_RING_SIZE) {
+            overruns++;
+            return false;
+        }
+        m_ring[head & (BRIDGE_RING_SIZE - 1)] = b;
+        m_head = head + 1;
+        return true;
+    }
+
+    size_t space() const {
+        return BRIDGE_RING_SIZE - (uint16_t)(m_head - m_tail);
+    }
+
+    // Consumer side. Returns true and fills out when a whole frame is in
+    // the ring; returns false straight away otherwise.
+    bool poll(uint32_t nowMs, BridgeFrame &out) {
+        while (true) {
+            uint16_t avail = m_head - m_tail;
+
+            if (!m_inFrame) {
+                while (avail && peek(0) != BRIDGE_START) {
+                    drop(1);
+                    discarded++;
+                    avail--;
+                }
+                if (!avail) return false;
+                m_inFrame = true;
+                m_startMs = nowMs;
+            }
+
+            if (avail >= BRIDGE_HEADER_LEN) {
+                uint16_t need = BRIDGE_HEADER_LEN + peek(1);
+                if (avail >= need) {
+                    out.len = peek(1);
+                    out.rspLen = peek(2);
+                    out.cmd = peek(3);
+                    for (uint16_t i = 0; i < out.len; i++) {
+                        out.data[i] = peek(BRIDGE_HEADER_LEN + i);
+                    }
+                    drop(need);
+                    m_inFrame = false;
+                    frames++;
+                    return true;
+                }
+            }
+
+            if ((uint32_t)(nowMs - m_startMs) < BRIDGE_FRAME_TIMEOUT_MS) return false;
+
+            // Deadline passed: this start byte was not a frame after all
+            drop(1);
+            m_inFrame = false;
+            timeouts++;
+        }
+    }
+
+    uint32_t frames;        // complete frames handed out
+    uint32_t timeouts;      // start bytes dropped at the deadline
+    uint32_t discarded;     // bytes skipped while looking for a start byte
+    uint32_t overruns;      // bytes lost to a full ring
+
+private:
+    uint8_t m_ring[BRIDGE_RING_SIZE];
+    volatile uint16_t m_head;       // written by push()
+    volatile uint16_t m_tail;       // written by poll()
+    bool m_inFrame;
+    uint32_t m_startMs;
+
+    uint8_t peek(uint16_t i) const {
+        return m_ring[(uint16_t)(m_tail + i) & (BRIDGE_RING_SIZE - 1)];
+    }
+
+    void drop(uint16_t n) { m_tail = m_tail + n; }
+};
+
+#endif // BRIDGE_PARSER_H
@@ -0,0 +1,101 @@
+/**
+ * Streaming CBOR writer for OBI ESP32
+ *
+ * The binary counterpart of JsonWriter (json_writer.h), with the same
+ * calls. Maps and arrays use the indefinite-length encoding (RFC 8949
+ * 3.2.2), so members can be written without counting them first. Only
+ * integers, booleans and text are supported, and floats are left out on
+ * purpose: callers send integer millivolts and centidegrees.
+ */
+
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define CBOR_UINT       0x00
+#define CBOR_NINT       0x20
+#define CBOR_TEXT       0x60
+#define CBOR_ARRAY      0x80
+#define CBOR_MAP        0xA0
+#define CBOR_FALSE      0xF4
+#define CBOR_TRUE       0xF5
+#define CBOR_INDEF      0x1F    // additional info: indefinite length
+#define CBOR_BREAK      0xFF
+
+class CborWriter {
+public:
+    CborWriter(uint8_t *buf, size_t size)
+        : m_buf(buf), m_size(size), m_len(0), m_overflow(false) {}
+
+    void beginMap() { put(CBOR_MAP | CBOR_INDEF); }
+    void beginMap(const char *k) { text(k); put(CBOR_MAP | CBOR_INDEF); }
+    void endMap() { put(CBOR_BREAK); }
+    void beginArray(const char *k) { text(k); put(CBOR_ARRAY | CBOR_INDEF); }
+    void endArray() { put(CBOR_BREAK); }
+
+    void add(const char *k, const char *value) { text(k); text(value); }
+    void add(const char *k, bool value) { text(k); put(value ? CBOR_TRUE : CBOR_FALSE); }
+    void add(const char *k, uint32_t value) { text(k); head(CBOR_UINT, value); }
+    void add(const char *k, int32_t value) { text(k); integer(value); }
+
+    // Array elements
+    void add(uint32_t value) { head(CBOR_UINT, value); }
+    void add(int32_t value) { integer(value); }
+
+    const uint8_t *data() const { return m_buf; }
+    size_t length() const { return m_len; }
+    bool overflow() const { return m_overflow; }
+
+private:
+    uint8_t *m_buf;
+    size_t m_size;
+    size_t m_len;
+    bool m_overflow;
+
+    void put(uint8_t b) {
+        if (m_len < m_size) {
+            m_buf[m_len++] = b;
+        } else {
+            m_overflow = true;
+        }
+    }
+
+    // Initial byte plus the shortest argument encoding
+    void head(uint8_t major, uint32_t value) {
+        if (value < 24) {
+            put(major | value);
+        } else if (value <= 0xFF) {
+            put(major | 24);
+            put(value);
+        } else if (value <= 0xFFFF) {
+            put(major | 25);
+            put(value >> 8);
+            put(value);
+        } else {
+            put(major | 26);
+            put(value >> 24);
+            put(value >> 16);
+            put(value >> 8);
+            put(value);
+        }
+    }
+
+    void integer(int32_t value) {
+        if (value < 0) {
+            head(CBOR_NINT, (uint32_t)(-1 - value));
+        } else {
+            head(CBOR_UINT, value);
+        }
+    }
+
+    void text(const char *s) {
+        size_t len = strlen(s);
+        head(CBOR_TEXT, len);
+        for (size_t i = 0; i < len; i++) put(s[i]);
+    }
+};
+
+#endif // CBOR_WRITER_H
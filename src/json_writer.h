@@ -0,0 +1,162 @@
+/**
+ * Streaming JSON writer for OBI ESP32
+ *
+ * Formats JSON straight into a caller-supplied buffer: no heap, no
+ * intermediate document and no printf (newlib's float formatting can
+ * allocate). addFixed() writes a scaled integer (millivolts as volts, say)
+ * without any float arithmetic; floats are written as fixed point with a
+ * given number of decimals. Output that does not fit is truncated and
+ * flagged, never overrun.
+ *
+ * Also used by the host benchmark (src/bench/), so it depends only on the
+ * C library.
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+class JsonWriter {
+public:
+    JsonWriter(char *buf, size_t size)
+        : m_buf(buf), m_size(size), m_len(0), m_overflow(size == 0), m_first(true) {}
+
+    void beginObject() { separator(); put('{'); m_first = true; }
+    void beginObject(const char *k) { key(k); put('{'); m_first = true; }
+    void endObject() { put('}'); m_first = false; }
+    void beginArray(const char *k) { key(k); put('['); m_first = true; }
+    void endArray() { put(']'); m_first = false; }
+
+    void add(const char *k, const char *value) { key(k); string(value); }
+    void add(const char *k, bool value) { key(k); raw(value ? "true" : "false"); }
+    void add(const char *k, uint32_t value) { key(k); number(value, false); }
+    void add(const char *k, int32_t value) { key(k); number(value < 0 ? -(int64_t)value : value, value < 0); }
+    void add(const char *k, float value, uint8_t decimals) { key(k); fixed(value, decimals); }
+
+    // value / 10^decimals, e.g. addFixed("v", 3304, 3) writes "v":3.304
+    void addFixed(const char *k, int32_t value, uint8_t decimals) {
+        key(k);
+        uint32_t units = value < 0 ? -(int64_t)value : value;
+        scaled(units, decimals, value < 0);
+    }
+
+    // Array elements
+    void add(uint32_t value) { separator(); number(value, false); }
+    void add(float value, uint8_t decimals) { separator(); fixed(value, decimals); }
+
+    // NUL-terminates the output; the buffer always has room for it
+    const char *c_str() const {
+        if (m_size) m_buf[m_len] = '\0';
+        return m_buf;
+    }
+    size_t length() const { return m_len; }
+    bool overflow() const { return m_overflow; }
+
+private:
+    char *m_buf;
+    size_t m_size;
+    size_t m_len;
+    bool m_overflow;
+    bool m_first;           // next member is the first in its container
+
+    void put(char c) {
+        if (m_len + 1 < m_size) {
+            m_buf[m_len++] = c;
+        } else {
+            m_overflow = true;
+        }
+    }
+
+    void raw(const char *s) {
+        while (*s) put(*s++);
+    }
+
+    void separator() {
+        if (!m_first) put(',');
+        m_first = false;
+    }
+
+    void key(const char *k) {
+        separator();
+        string(k);
+        put(':');
+    }
+
+    void string(const char *s) {
+        static const char hex[] = "0123456789abcdef";
+        put('"');
+        for (; *s; s++) {
+            uint8_t c = *s;
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(c);
+            } else if (c < 0x20) {
+                raw("\\u00");
+                put(hex[c >> 4]);
+                put(hex[c & 0x0F]);
+            } else {
+                put(c);
+            }
+        }
+        put('"');
+    }
+
+    void number(uint64_t value, bool negative) {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        if (negative) put('-');
+        while (n) put(digits[--n]);
+    }
+
+    void fixed(float value, uint8_t decimals) {
+        if (isnan(value) || isinf(value)) {
+            raw("null");
+            return;
+        }
+        if (decimals > 6) decimals = 6;
+
+        uint32_t scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+
+        // Single precision throughout: the C3 has no FPU and float is
+        // plenty for millivolts and centidegrees
+        bool negative = value < 0;
+        float units = fabsf(value) * scale + 0.5f;
+        if (units >= 4.0e9f) {
+            raw("null");
+            return;
+        }
+        scaled((uint32_t)units, decimals, negative);
+    }
+
+    void scaled(uint32_t units, uint8_t decimals, bool negative) {
+        if (decimals > 6) decimals = 6;
+
+        uint32_t scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+
+        uint32_t whole = units / scale;
+        uint32_t frac = units % scale;
+
+        number(whole, negative && units != 0);
+        if (!decimals) return;
+
+        put('.');
+        char digits[6];
+        for (int i = decimals - 1; i >= 0; i--) {
+            digits[i] = '0' + frac % 10;
+            frac /= 10;
+        }
+        for (int i = 0; i < decimals; i++) put(digits[i]);
+    }
+};
+
+#endif // JSON_WRITER_H
@@ -21,19 +21,31 @@
  * PROTOCOL (Serial Bridge):
  * Request:  [0x01][data_len][rsp_len][cmd][data...]
  * Response: [cmd][rsp_len][data...]
+ *           or, once negotiated via 0x01, COBS([cmd][rsp_len][data...][crc16]) 0x00
  *
  * AI-generated on 2025-12-16
  */
 
 #include <Arduino.h>
-#include "OneWire2.h"
+#include "battery.h"
+#include "bridge_parser.h"
+#include "bridge_framing.h"
 
 #ifdef ENABLE_WEB_SERVER
 #include <WiFi.h>
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
 #include <ArduinoOTA.h>
+#include <stdarg.h>
 #include "web_interface.h"
+#include "battery_json.h"
+#include "battery_cbor.h"
+#if __has_include("web_interface_gz.h")
+#include "web_interface_gz.h"       // generated by scripts/build_web.py
+#define WEB_UI_GZ 1
+#else
+#define WEB_UI_GZ 0
+#endif
 #if __has_include("secrets.h")
 #include "secrets.h"
 #endif
@@ -44,15 +56,40 @@
 #define OBI_VERSION_MINOR 0
 #define OBI_VERSION_PATCH 0
 
-// Pin definitions (can be overridden via build flags)
-#ifndef ONEWIRE_PIN
-#define ONEWIRE_PIN 3
+// Bus task: owns the enable pin and the makita object
+#define BUS_QUEUE_LEN 8
+#define BUS_TASK_STACK 4096
+#define BUS_TASK_PRIORITY 2
+
+// Background sampler: this long after the last full read (its own or a
+// client's) the bus task takes one itself, whatever other traffic the bus
+// saw meanwhile, and the read endpoints serve that snapshot unless asked
+// for ?fresh=1. 0 disables it (every read hits the bus); bridge-only
+// builds have nobody to serve and default to 0.
+#ifndef SAMPLE_INTERVAL_MS
+#ifdef ENABLE_WEB_SERVER
+#define SAMPLE_INTERVAL_MS 5000
+#else
+#define SAMPLE_INTERVAL_MS 0
+#endif
 #endif
 
-#ifndef ENABLE_PIN
-#define ENABLE_PIN 4
+// Bridge session: the host sends one frame at a time, so after a bridge
+// exchange the bus task keeps the pack powered this long for the next one
+// instead of paying the settle time per frame. A failed exchange releases
+// enable at once, so a removed or swapped pack is probed afresh. 0 gives
+// one enable window per frame.
+#ifndef BRIDGE_SESSION_IDLE_MS
+#define BRIDGE_SESSION_IDLE_MS 1000
 #endif
 
+// Telemetry stream (bridge opcode 0x54): the bus task holds the enable
+// window open and reads the voltages every period, queueing records for
+// loop() to send. Records that find the queue full are dropped; their
+// sequence numbers show the gap.
+#define STREAM_QUEUE_LEN 8
+#define STREAM_MIN_PERIOD_MS 50
+
 // WiFi credentials (for web server mode)
 #ifndef WIFI_SSID
 #define WIFI_SSID "YourSSID"
@@ -62,49 +99,138 @@
 #define WIFI_PASS "YourPassword"
 #endif
 
-// Nibble swap helper
-#define SWAP_NIBBLES(x) (((x) & 0x0F) << 4 | ((x) & 0xF0) >> 4)
-
-// Instantiate OneWire with template pin
-OneWire<ONEWIRE_PIN> makita;
+// Feed the bridge parser from the USB CDC RX event instead of polling
+// Serial in loop(). Only the hardware CDC (ARDUINO_USB_MODE=1) has the event.
+#ifndef SERIAL_RX_EVENT
+#define SERIAL_RX_EVENT 0
+#endif
 
 #ifdef ENABLE_WEB_SERVER
-WebServer server(80);
+AsyncWebServer server(80);
 #endif
 
-// Battery data structure
-struct BatteryData {
-    bool valid;
-    char model[16];
-    bool locked;
-    uint16_t chargeCount;
-    char mfgDate[16];
-    float capacity;
-    uint8_t errorCode;
-    uint8_t romId[8];
-    float packVoltage;
-    float cellVoltage[5];
-    float cellDiff;
-    float tempCell;
-    float tempMosfet;
+// Work items for the bus task. The caller owns the request and any buffers
+// it points at, and must not touch them until the request completes.
+enum BusRequestType {
+    BUS_REQ_INFO,
+    BUS_REQ_MODEL,
+    BUS_REQ_VOLTAGES,
+    BUS_REQ_ALL,
+    BUS_REQ_RAW33,      // cmd/rsp as for cmdAndRead33
+    BUS_REQ_RAWCC,      // cmd/rsp as for cmdAndReadCC
+    BUS_REQ_F0513,      // cmd[0] is the F0513 command, rsp receives 2 bytes
+    BUS_REQ_TEST_MODE,  // arg is the DA operand sent after entering test mode
+    BUS_REQ_SCRIPT,     // cmd is a bridge script; rspLen is the room in rsp,
+                        // then the length busScript() wrote
+    BUS_REQ_STREAM,     // cmd is the 0x54 payload; rsp receives 3 bytes
+    BUS_REQ_STREAM_SAMPLE   // queued by the bus task itself
+};
+
+struct BusRequest {
+    BusRequestType type;
+    byte *cmd;
+    uint8_t cmdLen;
+    byte *rsp;
+    uint8_t rspLen;
+    uint8_t arg;
+    bool success;
+    bool present;       // a pack answered the enable window's presence probe
+    bool coalesced;     // answered from a read already in flight
+    ReadTiming timing;
+    BatteryData *data;  // optional: receives the battery data when a read completes
+    uint32_t submittedMs;
+    uint32_t finishedMs;    // when the read that answered it completed
+    SemaphoreHandle_t done;
+    StaticSemaphore_t doneBuffer;
+};
+
+QueueHandle_t busQueue;
+
+// Latest full read, written by the bus task and copied out under the lock
+struct BatterySnapshot {
+    BatteryData data;
+    ReadTiming timing;
+    bool present;
+    uint8_t family;         // ProtocolFamily cached for data.romId
+    uint32_t takenMs;       // millis() at completion
+    uint32_t sequence;      // 0 until the first read
+};
+
+BatterySnapshot snapshot;
+portMUX_TYPE snapshotLock = portMUX_INITIALIZER_UNLOCKED;
+uint32_t samplerReads = 0;  // reads started by the sampler rather than a client
+uint32_t bridgeSessionFrames = 0;   // bridge exchanges that held enable for the next
+
+// One telemetry sample, as queued by the bus task. Sent over the bridge as
+// a 0x55 frame of STREAM_RECORD_LEN little-endian bytes in this order.
+struct StreamRecord {
+    uint32_t sequence;      // sample slot since the stream started
+    uint32_t timeMs;        // millis() when the read finished
+    uint16_t packMv;
+    uint16_t cellMv[5];
+    int16_t tempCellCentiC;
+    int16_t tempMosfetCentiC;
+    uint8_t status;         // 0 ok, 1 the read failed (values are zero)
 };
 
-BatteryData batteryData;
+#define STREAM_RECORD_LEN 25
+
+QueueHandle_t streamQueue;
+uint16_t streamPeriodMs = 0;        // 0 when not streaming; bus task only
+uint32_t streamStartMs;
+uint32_t streamSlot;                // next sample slot
+volatile bool streamActive = false;
+volatile bool streamCancel = false; // set by loop() when the host goes away
+uint32_t streamDropped = 0;         // records that found the queue full
+
+// Response framing chosen by the host in its last 0x01 request, back to
+// raw once that host disconnects
+uint8_t bridgeFraming = BRIDGE_FRAMING_RAW;
+
+// Single-flight reads: a read request (INFO..ALL) submitted while a read of
+// the same type was running takes that read's result instead of running
+// again. readFlights holds the last completed read of each type.
+#define BUS_READ_TYPES (BUS_REQ_ALL + 1)
+
+struct ReadFlight {
+    uint32_t startedMs;
+    uint32_t finishedMs;
+    bool done;
+    bool success;
+    bool present;
+    ReadTiming timing;
+    BatteryData data;
+};
+
+ReadFlight readFlights[BUS_READ_TYPES];
+uint32_t readsExecuted[BUS_READ_TYPES];
+uint32_t readsCoalesced[BUS_READ_TYPES];
 
 // Forward declarations
+void serialPump();
+#if SERIAL_RX_EVENT
+void serialRxEvent(void *arg, esp_event_base_t base, int32_t id, void *data);
+#endif
 void processSerialCommand();
-bool cmdAndRead33(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len);
-bool cmdAndReadCC(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len);
-void sendUSB(byte *rsp, byte rsp_len);
-void setEnable(bool high);
-void triggerPower();
-bool readBatteryInfo();
-bool readBatteryVoltages();
-bool readBatteryModel();
+void sendUSB(const byte *rsp, size_t len);
+void busRequestInit(BusRequest *req, BusRequestType type);
+bool busSubmit(BusRequest *req);
+bool busWait(BusRequest *req, uint32_t timeoutMs);
+void busExecute(BusRequest *req);
+bool busCoalesce(BusRequest *req);
+const char *busReadName(uint8_t type);
+void busTask(void *param);
+void snapshotStore(const BusRequest *req);
+void snapshotGet(BatterySnapshot *out);
+bool streamStart(uint16_t periodMs);
+bool streamSample();
+void streamPoll();
 
 #ifdef ENABLE_WEB_SERVER
 void setupWebServer();
 void setupOTA();
+void webJobsPoll();
+void eventsPoll();
 #endif
 
 // ------------------------------------------------------------------
@@ -112,6 +238,9 @@ void setupOTA();
 // ------------------------------------------------------------------
 void setup() {
     Serial.begin(115200);
+#if SERIAL_RX_EVENT
+    Serial.onEvent(ARDUINO_HW_CDC_RX_EVENT, serialRxEvent);
+#endif
 
     // Wait for serial connection (USB CDC)
     while (!Serial && millis() < 3000) {
@@ -124,6 +253,12 @@ void setup() {
 
     // Initialise battery data
     memset(&batteryData, 0, sizeof(batteryData));
+    protocolCacheLoad();
+
+    // Start the bus task before anything can submit requests
+    busQueue = xQueueCreate(BUS_QUEUE_LEN, sizeof(BusRequest *));
+    streamQueue = xQueueCreate(STREAM_QUEUE_LEN, sizeof(StreamRecord));
+    xTaskCreate(busTask, "obi_bus", BUS_TASK_STACK, nullptr, BUS_TASK_PRIORITY, nullptr);
 
     Serial.println("=================================");
     Serial.println("OBI ESP32-C3 - Open Battery Info");
@@ -131,6 +266,9 @@ void setup() {
     Serial.printf("Version: %d.%d.%d\n", OBI_VERSION_MAJOR, OBI_VERSION_MINOR, OBI_VERSION_PATCH);
     Serial.printf("OneWire Pin: GPIO%d\n", ONEWIRE_PIN);
     Serial.printf("Enable Pin: GPIO%d\n", ENABLE_PIN);
+#if ONEWIRE_RMT
+    Serial.println("OneWire: RMT");
+#endif
 
 #ifdef ENABLE_WEB_SERVER
     Serial.println("Mode: Web Server + Serial Bridge");
@@ -168,350 +306,471 @@ void setup() {
 void loop() {
 #ifdef ENABLE_WEB_SERVER
     ArduinoOTA.handle();
-    server.handleClient();
+    webJobsPoll();
+    eventsPoll();
+#endif
+#if !SERIAL_RX_EVENT
+    serialPump();
 #endif
     processSerialCommand();
+    streamPoll();
 }
 
 // ------------------------------------------------------------------
-// Enable pin control
+// Bus task
 // ------------------------------------------------------------------
-void setEnable(bool high) {
-    digitalWrite(ENABLE_PIN, high ? HIGH : LOW);
+
+void busRequestInit(BusRequest *req, BusRequestType type) {
+    memset(req, 0, sizeof(*req));
+    req->type = type;
+    req->done = xSemaphoreCreateBinaryStatic(&req->doneBuffer);
 }
 
-void triggerPower() {
-    setEnable(false);
-    delay(200);
-    setEnable(true);
-    delay(500);
+// Queue a request for the bus task. Returns false if the queue is full.
+bool busSubmit(BusRequest *req) {
+    req->submittedMs = millis();
+    return xQueueSend(busQueue, &req, 0) == pdTRUE;
 }
 
-// ------------------------------------------------------------------
-// OneWire command functions
-// ------------------------------------------------------------------
+// Wait up to timeoutMs for a submitted request. Returns true once it has
+// completed; the result fields are valid from then on.
+bool busWait(BusRequest *req, uint32_t timeoutMs) {
+    return xSemaphoreTake(req->done, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
 
-bool cmdAndRead33(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len) {
-    int i;
+void busExecute(BusRequest *req) {
+    switch (req->type) {
+        case BUS_REQ_INFO:
+            req->success = sessionReadInfo();
+            break;
+
+        case BUS_REQ_MODEL:
+            req->success = sessionReadModel();
+            break;
+
+        case BUS_REQ_VOLTAGES:
+            req->success = sessionReadVoltages();
+            break;
+
+        case BUS_REQ_ALL:
+            req->success = sessionReadAll(&req->timing);
+            break;
+
+        case BUS_REQ_RAW33:
+            req->success = cmdAndRead33(req->cmd, req->cmdLen, req->rsp, req->rspLen);
+            break;
+
+        case BUS_REQ_RAWCC:
+            req->success = cmdAndReadCC(req->cmd, req->cmdLen, req->rsp, req->rspLen);
+            break;
+
+        case BUS_REQ_F0513:
+            req->success = cmdAndReadF0513(req->cmd[0], req->rsp);
+            break;
+
+        case BUS_REQ_TEST_MODE:
+            req->success = sessionTestMode(req->arg);
+            break;
+
+        case BUS_REQ_SCRIPT:
+            req->rspLen = busScript(req->cmd, req->cmdLen, req->rsp, req->rspLen);
+            req->success = req->rsp[0] == SCRIPT_OK;
+            break;
+
+        case BUS_REQ_STREAM:
+            req->success = streamStart(req->cmdLen >= 2 ? req->cmd[0] | req->cmd[1] << 8 : 0);
+            req->rsp[0] = req->success ? 0 : 1;
+            req->rsp[1] = streamPeriodMs & 0xFF;
+            req->rsp[2] = streamPeriodMs >> 8;
+            break;
+
+        case BUS_REQ_STREAM_SAMPLE:
+            req->success = streamSample();
+            break;
+    }
+}
 
-    for (int retry = 0; retry < 3; retry++) {
-        if (!makita.reset()) {
-            triggerPower();
-            continue;
-        }
+const char *busReadName(uint8_t type) {
+    switch (type) {
+        case BUS_REQ_INFO:     return "info";
+        case BUS_REQ_MODEL:    return "model";
+        case BUS_REQ_VOLTAGES: return "voltages";
+        case BUS_REQ_ALL:      return "all";
+        default:               return "raw";
+    }
+}
 
-        delayMicroseconds(310);
-        makita.write(0x33);
+// Complete req from the last read of its type if that read was running
+// when req was submitted. Returns true if req needs no bus work.
+bool busCoalesce(BusRequest *req) {
+    if (req->type >= BUS_READ_TYPES) return false;
+    const ReadFlight &f = readFlights[req->type];
+    if (!f.done) return false;
+    if ((int32_t)(req->submittedMs - f.startedMs) < 0) return false;
+    if ((int32_t)(f.finishedMs - req->submittedMs) < 0) return false;
+
+    req->success = f.success;
+    req->present = f.present;
+    req->timing = f.timing;
+    req->finishedMs = f.finishedMs;
+    if (req->data) *req->data = f.data;
+    req->coalesced = true;
+    readsCoalesced[req->type]++;
+    return true;
+}
 
-        // Read 8-byte ROM ID
-        for (i = 0; i < 8; i++) {
-            delayMicroseconds(90);
-            rsp[i] = makita.read();
-        }
+void snapshotStore(const BusRequest *req) {
+    uint8_t family = protocolPeek(batteryData.romId);
+
+    portENTER_CRITICAL(&snapshotLock);
+    snapshot.data = batteryData;
+    snapshot.timing = req->timing;
+    snapshot.present = req->present;
+    snapshot.family = family;
+    snapshot.takenMs = millis();
+    snapshot.sequence++;
+    portEXIT_CRITICAL(&snapshotLock);
+}
 
-        // Write command
-        for (i = 0; i < cmd_len; i++) {
-            delayMicroseconds(90);
-            makita.write(cmd[i]);
-        }
+void snapshotGet(BatterySnapshot *out) {
+    portENTER_CRITICAL(&snapshotLock);
+    *out = snapshot;
+    portEXIT_CRITICAL(&snapshotLock);
+}
 
-        // Read response
-        for (i = 8; i < rsp_len + 8; i++) {
-            delayMicroseconds(90);
-            rsp[i] = makita.read();
-        }
+// Raw exchanges from the serial bridge
+static bool busBridgeRequest(const BusRequest *req) {
+    return req->type == BUS_REQ_RAW33 || req->type == BUS_REQ_RAWCC ||
+           req->type == BUS_REQ_F0513 || req->type == BUS_REQ_SCRIPT ||
+           req->type == BUS_REQ_STREAM;
+}
 
-        // Check if valid (not all 0xFF)
-        bool valid = false;
-        for (i = 0; i < rsp_len + 8; i++) {
-            if (rsp[i] != 0xFF) {
-                valid = true;
-                break;
-            }
-        }
-        if (valid) return true;
+// Next request for the open enable window: anything already queued, then
+// (while streaming) whatever arrives before the next sample is due or else
+// that sample, then (after a bridge exchange) whatever arrives within the
+// idle time. Returns false to close the window.
+static bool busNextInWindow(BusRequest **req, bool linger) {
+    static BusRequest sampleReq;
+
+    if (xQueueReceive(busQueue, req, 0) == pdTRUE) return true;
+
+    if (streamCancel) streamStart(0);
+    if (streamPeriodMs) {
+        int32_t wait = streamStartMs + streamSlot * streamPeriodMs - millis();
+        if (wait > 0 && xQueueReceive(busQueue, req, pdMS_TO_TICKS(wait)) == pdTRUE) return true;
+        busRequestInit(&sampleReq, BUS_REQ_STREAM_SAMPLE);
+        *req = &sampleReq;
+        return true;
     }
 
-    memset(rsp, 0xFF, rsp_len + 8);
-    return false;
+    return linger && BRIDGE_SESSION_IDLE_MS &&
+           xQueueReceive(busQueue, req, pdMS_TO_TICKS(BRIDGE_SESSION_IDLE_MS)) == pdTRUE;
 }
 
-bool cmdAndReadCC(byte *cmd, uint8_t cmd_len, byte *rsp, uint8_t rsp_len) {
-    int i;
-
-    for (int retry = 0; retry < 3; retry++) {
-        if (!makita.reset()) {
-            triggerPower();
-            continue;
+// Single owner of the battery bus. Requests that are already queued when
+// one finishes run in the same enable window, so a burst only pays the
+// settle time once; after a successful bridge exchange the window stays
+// open for BRIDGE_SESSION_IDLE_MS, and for as long as a telemetry stream
+// runs. SAMPLE_INTERVAL_MS after the last full read the task queues its
+// own to keep the snapshot current, busy bus or not.
+void busTask(void *param) {
+    static BusRequest sampleReq;
+    BusRequest *req;
+    uint32_t lastSampleMs = millis();
+
+    while (true) {
+        TickType_t wait = portMAX_DELAY;
+        if (SAMPLE_INTERVAL_MS) {
+            uint32_t elapsed = millis() - lastSampleMs;
+            wait = elapsed < SAMPLE_INTERVAL_MS ? pdMS_TO_TICKS(SAMPLE_INTERVAL_MS - elapsed) : 0;
         }
 
-        delayMicroseconds(310);
-        makita.write(0xCC);
-
-        // Write command
-        for (i = 0; i < cmd_len; i++) {
-            delayMicroseconds(90);
-            makita.write(cmd[i]);
+        if (xQueueReceive(busQueue, &req, wait) != pdTRUE) {
+            busRequestInit(&sampleReq, BUS_REQ_ALL);
+            req = &sampleReq;
+            samplerReads++;
         }
 
-        // Read response
-        for (i = 0; i < rsp_len; i++) {
-            delayMicroseconds(90);
-            rsp[i] = makita.read();
+        // A duplicate at the head of the queue needs no enable window
+        if (busCoalesce(req)) {
+            xSemaphoreGive(req->done);
+            continue;
         }
 
-        // Check if valid
-        bool valid = false;
-        for (i = 0; i < rsp_len; i++) {
-            if (rsp[i] != 0xFF) {
-                valid = true;
-                break;
+        beginSession();
+        uint32_t settleMs = sessionSettleMs;
+        bool linger;
+
+        do {
+            linger = false;
+            if (busCoalesce(req)) {
+                xSemaphoreGive(req->done);
+                continue;
             }
-        }
-        if (valid) return true;
-    }
 
-    memset(rsp, 0xFF, rsp_len);
-    return false;
+            uint32_t start = millis();
+            busExecute(req);
+            req->present = sessionPresent;
+            if (req->type == BUS_REQ_ALL) {
+                req->timing.settleMs = settleMs;
+                req->timing.totalMs = millis() - start + settleMs;
+                snapshotStore(req);
+                lastSampleMs = millis();
+            }
+            if (req->type < BUS_READ_TYPES) {
+                ReadFlight &f = readFlights[req->type];
+                f.startedMs = start - settleMs;
+                f.finishedMs = millis();
+                f.done = true;
+                f.success = req->success;
+                f.present = req->present;
+                f.timing = req->timing;
+                f.data = batteryData;
+                req->finishedMs = f.finishedMs;
+                if (req->data) *req->data = f.data;
+                readsExecuted[req->type]++;
+            }
+            linger = busBridgeRequest(req) && req->success && sessionPresent;
+            if (linger) bridgeSessionFrames++;
+            settleMs = 0;
+            xSemaphoreGive(req->done);
+        } while (busNextInWindow(&req, linger));
+
+        endSession();
+    }
 }
 
 // ------------------------------------------------------------------
-// High-level battery functions
+// Telemetry stream
 // ------------------------------------------------------------------
 
-bool readBatteryInfo() {
-    byte rsp[48];
-    byte cmd[] = {0xAA, 0x00};
-
-    setEnable(true);
-    delay(400);
-
-    bool success = cmdAndRead33(cmd, 2, rsp, 40);
-
-    if (success) {
-        // Copy ROM ID
-        memcpy(batteryData.romId, rsp, 8);
-
-        // Parse message data (offset by 8 for ROM ID)
-        byte *msg = &rsp[8];
-
-        // Manufacturing date is in ROM ID bytes - use ISO 8601 (YYYY-MM-DD)
-        // romId[0] = year, romId[1] = month, romId[2] = day
-        snprintf(batteryData.mfgDate, sizeof(batteryData.mfgDate),
-                 "20%02d-%02d-%02d",
-                 batteryData.romId[0],   // year
-                 batteryData.romId[1],   // month
-                 batteryData.romId[2]);  // day
-
-        // Charge count
-        uint16_t rawCount = ((uint16_t)SWAP_NIBBLES(msg[29])) |
-                           (((uint16_t)SWAP_NIBBLES(msg[28])) << 8);
-        batteryData.chargeCount = rawCount & 0x0FFF;
+// Start streaming every periodMs (clamped to STREAM_MIN_PERIOD_MS), or stop
+// with 0. Runs on the bus task in an open window; fails without a pack.
+bool streamStart(uint16_t periodMs) {
+    bool ok = true;
 
-        // Lock status
-        batteryData.locked = (msg[22] & 0x0F) > 0;
-
-        // Error code
-        batteryData.errorCode = msg[21] & 0x0F;
-
-        // Capacity
-        batteryData.capacity = SWAP_NIBBLES(msg[18]) / 10.0f;
-
-        batteryData.valid = true;
+    if (periodMs && !sessionPresent) {
+        periodMs = 0;
+        ok = false;
     }
-
-    setEnable(false);
-    return success;
+    if (periodMs && periodMs < STREAM_MIN_PERIOD_MS) periodMs = STREAM_MIN_PERIOD_MS;
+
+    streamPeriodMs = periodMs;
+    streamStartMs = millis();
+    streamSlot = 0;
+    streamCancel = false;
+    streamActive = periodMs != 0;
+    return ok;
 }
 
-bool readBatteryModel() {
-    byte rsp[16];
-    byte cmd[] = {0xDC, 0x0C};
-
-    setEnable(true);
-    delay(400);
-
-    bool success = cmdAndReadCC(cmd, 2, rsp, 10);
-
-    if (success && rsp[0] != 0xFF) {
-        // Copy model string (null-terminate)
-        memcpy(batteryData.model, rsp, 7);
-        batteryData.model[7] = '\0';
-    } else {
-        // Try F0513 method for older batteries
-        makita.reset();
-        delayMicroseconds(400);
-        makita.write(0xCC);
-        delayMicroseconds(90);
-        makita.write(0x99);
-        delay(400);
-        makita.reset();
-        delayMicroseconds(400);
-        makita.write(0x31);
-        delayMicroseconds(90);
-        byte b1 = makita.read();
-        delayMicroseconds(90);
-        byte b0 = makita.read();
-
-        if (b0 != 0xFF && b1 != 0xFF) {
-            snprintf(batteryData.model, sizeof(batteryData.model), "BL%02X%02X", b1, b0);
-            success = true;
-        }
-    }
-
-    setEnable(false);
-    return success;
+// Take the sample for the current slot. Slots the bus task was too busy to
+// sample are skipped, so the sequence numbers stay tied to time.
+bool streamSample() {
+    StreamRecord rec;
+    bool ok = sessionReadVoltages();
+
+    rec.sequence = streamSlot;
+    rec.timeMs = millis();
+    rec.packMv = batteryData.packMv;
+    memcpy(rec.cellMv, batteryData.cellMv, sizeof(rec.cellMv));
+    rec.tempCellCentiC = batteryData.tempCellCentiC;
+    rec.tempMosfetCentiC = batteryData.tempMosfetCentiC;
+    rec.status = ok ? 0 : 1;
+    if (xQueueSend(streamQueue, &rec, 0) != pdTRUE) streamDropped++;
+
+    streamSlot = (rec.timeMs - streamStartMs) / streamPeriodMs + 1;
+    return ok;
 }
 
-bool readBatteryVoltages() {
-    byte rsp[32];
-    byte cmd[] = {0xD7, 0x00, 0x00, 0xFF};
-
-    setEnable(true);
-    delay(400);
+static byte *put16(byte *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
 
-    bool success = cmdAndReadCC(cmd, 4, rsp, 29);
+static byte *put32(byte *p, uint32_t v) {
+    return put16(put16(p, v), v >> 16);
+}
 
-    if (success && rsp[0] != 0xFF) {
-        batteryData.packVoltage = ((uint16_t)rsp[0] | ((uint16_t)rsp[1] << 8)) / 1000.0f;
+// Send queued records from loop(), where every other bridge response is
+// written, so frames never interleave. Stops the stream if the host has
+// closed the port.
+void streamPoll() {
+    static byte frame[2 + STREAM_RECORD_LEN];
+    StreamRecord rec;
+
+    // Host gone: stop its stream, and let the next host start with raw
+    // responses until it asks for framing itself
+    if (!Serial) {
+        if (streamActive) streamCancel = true;
+        bridgeFraming = BRIDGE_FRAMING_RAW;
+    }
 
-        float maxV = 0, minV = 5;
+    while (xQueueReceive(streamQueue, &rec, 0) == pdTRUE) {
+        byte *p = frame;
+        *p++ = 0x55;
+        *p++ = STREAM_RECORD_LEN;
+        p = put32(p, rec.sequence);
+        p = put32(p, rec.timeMs);
+        p = put16(p, rec.packMv);
         for (int i = 0; i < 5; i++) {
-            float v = ((uint16_t)rsp[2 + i*2] | ((uint16_t)rsp[3 + i*2] << 8)) / 1000.0f;
-            batteryData.cellVoltage[i] = v;
-            if (v > maxV) maxV = v;
-            if (v < minV) minV = v;
-        }
-        batteryData.cellDiff = maxV - minV;
-
-        // Cell temperature (offset 14-15)
-        int16_t tempRaw = (int16_t)rsp[14] | ((int16_t)rsp[15] << 8);
-        batteryData.tempCell = tempRaw / 100.0f;
-
-        // MOSFET temperature (offset 16-17)
-        int16_t tempMosfetRaw = (int16_t)rsp[16] | ((int16_t)rsp[17] << 8);
-        batteryData.tempMosfet = tempMosfetRaw / 100.0f;
-    } else {
-        // Try F0513 method
-        byte vcmd[1];
-        bool f0513_ok = true;
-
-        for (int i = 0; i < 5 && f0513_ok; i++) {
-            vcmd[0] = 0x31 + i;
-            if (cmdAndReadCC(vcmd, 1, rsp, 2)) {
-                batteryData.cellVoltage[i] = ((uint16_t)rsp[0] | ((uint16_t)rsp[1] << 8)) / 1000.0f;
-            } else {
-                f0513_ok = false;
-            }
-        }
-
-        if (f0513_ok) {
-            // Calculate pack voltage and diff
-            float sum = 0, maxV = 0, minV = 5;
-            for (int i = 0; i < 5; i++) {
-                sum += batteryData.cellVoltage[i];
-                if (batteryData.cellVoltage[i] > maxV) maxV = batteryData.cellVoltage[i];
-                if (batteryData.cellVoltage[i] < minV) minV = batteryData.cellVoltage[i];
-            }
-            batteryData.packVoltage = sum;
-            batteryData.cellDiff = maxV - minV;
-
-            // Temperature (F0513 only has cell temp, no MOSFET temp)
-            vcmd[0] = 0x52;
-            if (cmdAndReadCC(vcmd, 1, rsp, 2)) {
-                batteryData.tempCell = ((uint16_t)rsp[0] | ((uint16_t)rsp[1] << 8)) / 100.0f;
-                batteryData.tempMosfet = 0;  // Not available on F0513
-            }
-            success = true;
+            p = put16(p, rec.cellMv[i]);
         }
+        p = put16(p, rec.tempCellCentiC);
+        p = put16(p, rec.tempMosfetCentiC);
+        *p++ = rec.status;
+        sendUSB(frame, p - frame);
     }
-
-    setEnable(false);
-    return success;
 }
 
 // ------------------------------------------------------------------
 // Serial communication (OBI Protocol)
 // ------------------------------------------------------------------
 
-void sendUSB(byte *rsp, byte rsp_len) {
-    for (int i = 0; i < rsp_len; i++) {
-        Serial.write(rsp[i]);
+byte serialTx[BRIDGE_COBS_MAX(2 + 8 + 255)];
+
+// One response as a single write, so USB CDC sends it in as few packets
+// as it can rather than one per byte
+void sendUSB(const byte *rsp, size_t len) {
+    if (bridgeFraming == BRIDGE_FRAMING_COBS) {
+        Serial.write(serialTx, bridgeCobsFrame(rsp, len, serialTx));
+    } else {
+        Serial.write(rsp, len);
     }
 }
 
-void processSerialCommand() {
-    if (Serial.available() >= 4) {
-        byte start = Serial.read();
-        byte len;
-        byte rsp_len;
-        byte cmd;
-        byte data[255];
-        byte rsp[255];
-
-        if (start != 0x01) {
-            return;
-        }
+// Bytes from the host, parsed into frames without blocking (bridge_parser.h)
+BridgeParser bridgeParser;
+BridgeFrame bridgeFrame;
+
+// Move whatever the host has sent into the parser's ring
+void serialPump() {
+    size_t n = Serial.available();
+    size_t space = bridgeParser.space();
+    if (n > space) n = space;
+    while (n--) {
+        bridgeParser.push(Serial.read());
+    }
+}
+
+#if SERIAL_RX_EVENT
+void serialRxEvent(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    serialPump();
+}
+#endif
 
-        len = Serial.read();
-        rsp_len = Serial.read();
-        cmd = Serial.read();
+// Bridge frame currently with the bus task. The host waits for each
+// response before sending the next frame, so one slot is enough.
+BusRequest serialReq;
+bool serialPending = false;
+byte serialCmd;
+byte serialRsp[2 + 8 + 255];
 
-        if (len > 0) {
-            for (int i = 0; i < len; i++) {
-                while (Serial.available() < 1) {}
-                data[i] = Serial.read();
-            }
+void processSerialCommand() {
+    if (serialPending) {
+        if (!busWait(&serialReq, 0)) return;
+        serialPending = false;
+
+        if (serialCmd == 0x31 || serialCmd == 0x32) {
+            // F0513 replies high byte first; the bridge sends it low byte first
+            byte b = serialRsp[2];
+            serialRsp[2] = serialRsp[3];
+            serialRsp[3] = b;
         }
+        if (serialCmd == 0x53) serialRsp[1] = serialReq.rspLen;
+        sendUSB(serialRsp, serialRsp[1] + 2);
+        return;
+    }
 
-        setEnable(true);
-        delay(400);
+    if (bridgeParser.poll(millis(), bridgeFrame)) {
+        byte len = bridgeFrame.len;
+        byte rsp_len = bridgeFrame.rspLen;
+        byte cmd = bridgeFrame.cmd;
+
+        serialCmd = cmd;
+        serialRsp[0] = cmd;
+        serialRsp[1] = rsp_len;
 
         switch (cmd) {
             case 0x01:
-                rsp[0] = 0x01;
-                rsp[1] = rsp_len;
-                rsp[2] = OBI_VERSION_MAJOR;
-                rsp[3] = OBI_VERSION_MINOR;
-                rsp[4] = OBI_VERSION_PATCH;
-                break;
+                // Version. A data byte asks for a response framing; the
+                // reply still goes out in the old one, and a 4th reply byte
+                // says which framing applies from the next response on.
+                // Hosts that send no data get BRIDGE_FRAMING_RAW.
+                serialRsp[2] = OBI_VERSION_MAJOR;
+                serialRsp[3] = OBI_VERSION_MINOR;
+                serialRsp[4] = OBI_VERSION_PATCH;
+                {
+                    uint8_t framing = len && bridgeFrame.data[0] == BRIDGE_FRAMING_COBS ?
+                                      BRIDGE_FRAMING_COBS : BRIDGE_FRAMING_RAW;
+                    serialRsp[5] = framing;
+                    sendUSB(serialRsp, rsp_len + 2);
+                    bridgeFraming = framing;
+                }
+                return;
+
+            case 0x4D:
+                // Bus metrics; answered with their own length, no bus access
+                serialRsp[1] = busMetricsEncode(&serialRsp[2], 255);
+                sendUSB(serialRsp, serialRsp[1] + 2);
+                return;
 
             case 0x31:
-            case 0x32: {
-                makita.reset();
-                delayMicroseconds(400);
-                makita.write(0xCC);
-                delayMicroseconds(90);
-                makita.write(0x99);
-                delay(400);
-                makita.reset();
-                delayMicroseconds(400);
-                makita.write(cmd);
-                delayMicroseconds(90);
-                rsp[3] = makita.read();
-                delayMicroseconds(90);
-                rsp[2] = makita.read();
+            case 0x32:
+                busRequestInit(&serialReq, BUS_REQ_F0513);
+                serialReq.cmd = &serialCmd;
                 break;
-            }
 
             case 0x33:
-                cmdAndRead33(data, len, &rsp[2], rsp_len);
+                busRequestInit(&serialReq, BUS_REQ_RAW33);
                 break;
 
             case 0xCC:
-                cmdAndReadCC(data, len, &rsp[2], rsp_len);
+                busRequestInit(&serialReq, BUS_REQ_RAWCC);
                 break;
 
-            default:
-                rsp_len = 0;
+            case 0x53:
+                // Script (see busScript); answered with its own length
+                busRequestInit(&serialReq, BUS_REQ_SCRIPT);
+                rsp_len = 255;
+                break;
+
+            case 0x54:
+                // Telemetry stream: data is the period in ms (LE), 0 stops.
+                // Answered with [status][period in effect, LE]; records
+                // follow as 0x55 frames (see streamPoll)
+                busRequestInit(&serialReq, BUS_REQ_STREAM);
+                rsp_len = 3;
+                serialRsp[1] = rsp_len;
                 break;
-        }
 
-        rsp[0] = cmd;
-        rsp[1] = rsp_len;
-        sendUSB(rsp, rsp_len + 2);
+            default:
+                serialRsp[1] = 0;
+                sendUSB(serialRsp, 2);
+                return;
+        }
 
-        setEnable(false);
+        if (serialReq.type != BUS_REQ_F0513) {
+            serialReq.cmd = bridgeFrame.data;
+            serialReq.cmdLen = len;
+        }
+        serialReq.rsp = &serialRsp[2];
+        serialReq.rspLen = rsp_len;
+
+        if (!busSubmit(&serialReq)) {
+            // Queue full: answer like a failed exchange
+            if (cmd == 0x53) {
+                serialRsp[1] = 2;
+                serialRsp[2] = SCRIPT_BUSY;
+                serialRsp[3] = 0;
+                sendUSB(serialRsp, 4);
+                return;
+            }
+            memset(&serialRsp[2], 0xFF, rsp_len);
+            sendUSB(serialRsp, rsp_len + 2);
+            return;
+        }
+        serialPending = true;
     }
 }
 
@@ -555,103 +814,656 @@ void setupOTA() {
 // ------------------------------------------------------------------
 
 #ifdef ENABLE_WEB_SERVER
-void handleRoot() {
-    server.send_P(200, "text/html", INDEX_HTML);
+// The page is served gzipped with a strong ETag. Cache-Control: no-cache
+// makes browsers revalidate on every load, which costs a 304 until the
+// firmware (and so the ETag) changes. Clients that do not take gzip, and
+// builds without the generated header, get the plain page.
+void handleRoot(AsyncWebServerRequest *request) {
+#if WEB_UI_GZ
+    const AsyncWebHeader *accept = request->getHeader("Accept-Encoding");
+    if (accept && accept->value().indexOf("gzip") >= 0) {
+        const AsyncWebHeader *match = request->getHeader("If-None-Match");
+        AsyncWebServerResponse *response;
+        if (match && match->value() == INDEX_HTML_ETAG) {
+            response = request->beginResponse(304);
+        } else {
+            response = request->beginResponse(200, "text/html", INDEX_HTML_GZ, INDEX_HTML_GZ_LEN);
+            response->addHeader("Content-Encoding", "gzip");
+        }
+        response->addHeader("ETag", INDEX_HTML_ETAG);
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("Vary", "Accept-Encoding");
+        request->send(response);
+        return;
+    }
+#endif
+    request->send(200, "text/html", INDEX_HTML);
+}
+
+// Reply used when the bus queue or the job table is full
+void sendBusy(AsyncWebServerRequest *request) {
+    request->send(503, "application/json", "{\"success\":false,\"error\":\"busy\"}");
+}
+
+// True if the client asked for a live read, or there is nothing to serve
+bool wantFresh(AsyncWebServerRequest *request) {
+    if (!SAMPLE_INTERVAL_MS || !snapshot.sequence) return true;
+    return request->hasArg("fresh") && request->arg("fresh") == "1";
+}
+
+// ------------------------------------------------------------------
+// Deferred replies
+// ------------------------------------------------------------------
+
+// Handlers run on the async TCP task and must not block, so a handler that
+// needs the bus parks its request in a job slot and returns. loop() polls
+// the slots and sends the reply once the bus task has finished; if the
+// client has gone by then the reply is dropped.
+#define WEB_JOBS 4
+
+struct WebJob;
+typedef void (*WebReply)(AsyncWebServerRequest *request, const WebJob *job);
+
+struct WebJob {
+    volatile bool active;       // claimed by a handler, released by webJobsPoll
+    BusRequest bus;
+    BatteryData data;           // copied by the bus task when a read completes
+    AsyncWebServerRequestPtr client;
+    WebReply reply;
+};
+
+WebJob webJobs[WEB_JOBS];
+
+// Queue a bus request for this HTTP request. Replies 503 if no slot is free
+// or the bus queue is full.
+bool webBusRequest(AsyncWebServerRequest *request, BusRequestType type, uint8_t arg, WebReply reply) {
+    WebJob *job = nullptr;
+    for (int i = 0; i < WEB_JOBS; i++) {
+        if (!webJobs[i].active) {
+            job = &webJobs[i];
+            break;
+        }
+    }
+    if (!job) {
+        sendBusy(request);
+        return false;
+    }
+
+    busRequestInit(&job->bus, type);
+    job->bus.arg = arg;
+    job->bus.data = &job->data;
+    job->reply = reply;
+    if (!busSubmit(&job->bus)) {
+        sendBusy(request);
+        return false;
+    }
+    job->client = request->pause();
+    job->active = true;
+    return true;
+}
+
+void webJobsPoll() {
+    for (int i = 0; i < WEB_JOBS; i++) {
+        WebJob &job = webJobs[i];
+        if (!job.active || !busWait(&job.bus, 0)) continue;
+
+        if (auto request = job.client.lock()) {
+            job.reply(request.get(), &job);
+        }
+        job.client.reset();
+        job.active = false;
+    }
+}
+
+// ------------------------------------------------------------------
+// Slot responses
+// ------------------------------------------------------------------
+
+// The battery endpoints render with JsonWriter or CborWriter into one of
+// these slots and the response filler copies the slot into the socket, so
+// the hot path makes no heap allocations of its own (the server still
+// allocates its response object). A slot is freed once its last byte has
+// been handed to the server, or when the client goes away first.
+#define RESPONSE_SLOTS 4
+#define RESPONSE_SLOT_SIZE 768
+
+struct ResponseSlot {
+    char buf[RESPONSE_SLOT_SIZE];
+    size_t len;
+    AsyncWebServerRequest *owner;
+};
+
+ResponseSlot responseSlots[RESPONSE_SLOTS];
+portMUX_TYPE responseSlotLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Claim a free slot for request; replies 503 if there is none
+ResponseSlot *responseSlotClaim(AsyncWebServerRequest *request) {
+    ResponseSlot *slot = nullptr;
+    portENTER_CRITICAL(&responseSlotLock);
+    for (int i = 0; i < RESPONSE_SLOTS; i++) {
+        if (!responseSlots[i].owner) {
+            slot = &responseSlots[i];
+            slot->owner = request;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&responseSlotLock);
+
+    if (!slot) sendBusy(request);
+    return slot;
+}
+
+void responseSlotRelease(ResponseSlot *slot, AsyncWebServerRequest *request) {
+    portENTER_CRITICAL(&responseSlotLock);
+    if (slot->owner == request) slot->owner = nullptr;
+    portEXIT_CRITICAL(&responseSlotLock);
+}
+
+// Send the first len bytes of slot->buf; overflow means the writer ran out
+// of room and nothing usable was rendered. The slot endpoints pick JSON or
+// CBOR from Accept (wantCbor), so caches are told so with Vary.
+void responseSlotSend(AsyncWebServerRequest *request, ResponseSlot *slot,
+                      const char *contentType, size_t len, bool overflow) {
+    AsyncWebServerResponse *response;
+
+    if (overflow) {
+        responseSlotRelease(slot, request);
+        response = request->beginResponse(500, "application/json", "{\"success\":false,\"error\":\"overflow\"}");
+        response->addHeader("Vary", "Accept");
+        request->send(response);
+        return;
+    }
+
+    slot->len = len;
+    request->onDisconnect([slot, request]() {
+        responseSlotRelease(slot, request);
+    });
+    response = request->beginResponse(contentType, slot->len,
+        [slot, request](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+            size_t n = slot->len - index;
+            if (n > maxLen) n = maxLen;
+            memcpy(buf, &slot->buf[index], n);
+            if (index + n >= slot->len) responseSlotRelease(slot, request);
+            return n;
+        });
+    response->addHeader("Vary", "Accept");
+    request->send(response);
+}
+
+// Machine clients ask for CBOR with Accept: application/cbor
+bool wantCbor(AsyncWebServerRequest *request) {
+    const AsyncWebHeader *accept = request->getHeader("Accept");
+    return accept && accept->value().indexOf("application/cbor") >= 0;
+}
+
+// ------------------------------------------------------------------
+// API handlers
+// ------------------------------------------------------------------
+
+// Full read as sent by /api/read and the event stream
+void snapshotToJson(JsonWriter &w, const BatterySnapshot &snap, bool fresh) {
+    w.beginObject();
+    w.add("success", snap.data.valid);
+    w.add("voltagesValid", snap.data.voltagesValid);
+    w.add("present", snap.present);
+    w.add("fresh", fresh);
+    w.add("ageMs", (uint32_t)(millis() - snap.takenMs));
+    jsonBatteryInfo(w, snap.data);
+    jsonBatteryVoltages(w, snap.data);
+    w.add("protocol", protocolName(snap.family));
+    jsonReadTiming(w, snap.timing);
+    w.endObject();
+}
+
+void snapshotToCbor(CborWriter &w, const BatterySnapshot &snap, bool fresh) {
+    w.beginMap();
+    w.add("success", snap.data.valid);
+    w.add("voltagesValid", snap.data.voltagesValid);
+    w.add("present", snap.present);
+    w.add("fresh", fresh);
+    w.add("ageMs", (uint32_t)(millis() - snap.takenMs));
+    cborBatteryInfo(w, snap.data);
+    cborBatteryVoltages(w, snap.data);
+    w.add("protocol", protocolName(snap.family));
+    cborReadTiming(w, snap.timing);
+    w.endMap();
+}
+
+void sendRead(AsyncWebServerRequest *request, bool fresh) {
+    ResponseSlot *slot = responseSlotClaim(request);
+    if (!slot) return;
+
+    BatterySnapshot snap;
+    snapshotGet(&snap);
+
+    if (wantCbor(request)) {
+        CborWriter w((uint8_t *)slot->buf, sizeof(slot->buf));
+        snapshotToCbor(w, snap, fresh);
+        responseSlotSend(request, slot, "application/cbor", w.length(), w.overflow());
+    } else {
+        JsonWriter w(slot->buf, sizeof(slot->buf));
+        snapshotToJson(w, snap, fresh);
+        responseSlotSend(request, slot, "application/json", w.length(), w.overflow());
+    }
+}
+
+void replyRead(AsyncWebServerRequest *request, const WebJob *job) {
+    sendRead(request, true);
+}
+
+// Serves the sampler's snapshot; ?fresh=1 reads the battery first
+void handleApiRead(AsyncWebServerRequest *request) {
+    if (wantFresh(request)) {
+        webBusRequest(request, BUS_REQ_ALL, 0, replyRead);
+        return;
+    }
+    sendRead(request, false);
 }
 
-void handleApiRead() {
-    readBatteryInfo();
-    readBatteryModel();
-    readBatteryVoltages();
+void sendVoltages(AsyncWebServerRequest *request, const BatteryData &data, bool success,
+                  bool fresh, uint32_t takenMs) {
+    ResponseSlot *slot = responseSlotClaim(request);
+    if (!slot) return;
+
+    if (wantCbor(request)) {
+        CborWriter w((uint8_t *)slot->buf, sizeof(slot->buf));
+        w.beginMap();
+        w.add("success", success);
+        w.add("fresh", fresh);
+        w.add("ageMs", (uint32_t)(millis() - takenMs));
+        cborBatteryVoltages(w, data);
+        w.endMap();
+        responseSlotSend(request, slot, "application/cbor", w.length(), w.overflow());
+    } else {
+        JsonWriter w(slot->buf, sizeof(slot->buf));
+        w.beginObject();
+        w.add("success", success);
+        w.add("fresh", fresh);
+        w.add("ageMs", (uint32_t)(millis() - takenMs));
+        jsonBatteryVoltages(w, data);
+        w.endObject();
+        responseSlotSend(request, slot, "application/json", w.length(), w.overflow());
+    }
+}
+
+void replyVoltages(AsyncWebServerRequest *request, const WebJob *job) {
+    sendVoltages(request, job->data, job->bus.success, true, job->bus.finishedMs);
+}
+
+// Voltages from the snapshot; ?fresh=1 does a voltage-only read instead
+void handleApiVoltages(AsyncWebServerRequest *request) {
+    if (wantFresh(request)) {
+        webBusRequest(request, BUS_REQ_VOLTAGES, 0, replyVoltages);
+        return;
+    }
+    BatterySnapshot snap;
+    snapshotGet(&snap);
+    sendVoltages(request, snap.data, snap.data.voltagesValid, false, snap.takenMs);
+}
 
+void handleApiWake(AsyncWebServerRequest *request) {
     JsonDocument doc;
-    doc["success"] = batteryData.valid;
-    doc["model"] = batteryData.model;
-    doc["locked"] = batteryData.locked;
-    doc["chargeCount"] = batteryData.chargeCount;
-    doc["mfgDate"] = batteryData.mfgDate;
-    doc["capacity"] = batteryData.capacity;
-    doc["errorCode"] = batteryData.errorCode;
-    doc["packVoltage"] = batteryData.packVoltage;
-    doc["cell1"] = batteryData.cellVoltage[0];
-    doc["cell2"] = batteryData.cellVoltage[1];
-    doc["cell3"] = batteryData.cellVoltage[2];
-    doc["cell4"] = batteryData.cellVoltage[3];
-    doc["cell5"] = batteryData.cellVoltage[4];
-    doc["cellDiff"] = batteryData.cellDiff;
-    doc["tempCell"] = batteryData.tempCell;
-    doc["tempMosfet"] = batteryData.tempMosfet;
+    doc["adaptive"] = WAKE_ADAPTIVE ? true : false;
+    doc["deadlineMs"] = WAKE_DEADLINE_MS;
+
+    JsonArray batteries = doc["batteries"].to<JsonArray>();
+    for (int i = 0; i < WAKE_STATS_SLOTS; i++) {
+        const WakeStats &ws = wakeStats[i];
+        if (!ws.samples) continue;
+
+        char rom[17];
+        for (int j = 0; j < 8; j++) {
+            snprintf(&rom[j * 2], 3, "%02X", ws.romId[j]);
+        }
+
+        JsonObject b = batteries.add<JsonObject>();
+        b["romId"] = rom;
+        b["samples"] = ws.samples;
+        b["lastMs"] = ws.lastMs;
+        b["minMs"] = ws.minMs;
+        b["maxMs"] = ws.maxMs;
+    }
 
     String response;
     serializeJson(doc, response);
-    server.send(200, "application/json", response);
+    request->send(200, "application/json", response);
 }
 
-void handleApiVoltages() {
-    bool success = readBatteryVoltages();
+// Bus counters and per-opcode latency histograms since boot
+void handleApiMetrics(AsyncWebServerRequest *request) {
+    JsonDocument doc;
+    doc["uptimeMs"] = millis();
+    doc["resets"] = busMetrics.resets;
+    doc["noPresence"] = busMetrics.noPresence;
+    doc["powerCycles"] = busMetrics.powerCycles;
+    doc["retries"] = busMetrics.retries;
+    doc["wakePolls"] = busMetrics.wakePolls;
+    doc["wakeTimeouts"] = busMetrics.wakeTimeouts;
+
+    JsonObject reads = doc["reads"].to<JsonObject>();
+    for (int t = 0; t < BUS_READ_TYPES; t++) {
+        JsonObject r = reads[busReadName(t)].to<JsonObject>();
+        r["executed"] = readsExecuted[t];
+        r["coalesced"] = readsCoalesced[t];
+    }
+
+    JsonArray bounds = doc["bucketsMs"].to<JsonArray>();
+    for (int b = 0; b < LATENCY_BUCKETS - 1; b++) {
+        bounds.add(latencyBoundsMs[b]);
+    }
+
+    JsonObject latency = doc["latency"].to<JsonObject>();
+    for (int op = 0; op < BUS_OPS; op++) {
+        const LatencyHistogram &h = busMetrics.latency[op];
+        JsonObject l = latency[busOpcodeName(op)].to<JsonObject>();
+        l["count"] = h.count;
+        l["totalMs"] = h.totalMs;
+        l["maxMs"] = h.maxMs;
+        JsonArray buckets = l["buckets"].to<JsonArray>();
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            buckets.add(h.buckets[b]);
+        }
+    }
+
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+}
 
+// Validation outcomes per frame kind since boot
+void handleApiFrames(AsyncWebServerRequest *request) {
     JsonDocument doc;
-    doc["success"] = success;
-    doc["packVoltage"] = batteryData.packVoltage;
-    doc["cell1"] = batteryData.cellVoltage[0];
-    doc["cell2"] = batteryData.cellVoltage[1];
-    doc["cell3"] = batteryData.cellVoltage[2];
-    doc["cell4"] = batteryData.cellVoltage[3];
-    doc["cell5"] = batteryData.cellVoltage[4];
-    doc["cellDiff"] = batteryData.cellDiff;
-    doc["tempCell"] = batteryData.tempCell;
-    doc["tempMosfet"] = batteryData.tempMosfet;
+    doc["strict"] = FRAME_STRICT ? true : false;
+    doc["retries"] = FRAME_RETRIES;
+
+    JsonObject frames = doc["frames"].to<JsonObject>();
+    for (int i = 0; i < FRAME_KINDS; i++) {
+        const FrameStats &fs = frameStats[i];
+        JsonObject f = frames[frameKindName(i)].to<JsonObject>();
+        f["ok"] = fs.ok;
+        f["retries"] = fs.retries;
+        f["failures"] = fs.failures;
+        f["noPresence"] = fs.noPresence;
+        f["blank"] = fs.blank;
+        f["romMismatch"] = fs.romMismatch;
+        f["badCrc"] = fs.badCrc;
+        f["noAck"] = fs.noAck;
+        f["range"] = fs.range;
+        f["lastErrorMs"] = fs.lastErrorMs;
+    }
+    doc["uptimeMs"] = millis();
 
     String response;
     serializeJson(doc, response);
-    server.send(200, "application/json", response);
+    request->send(200, "application/json", response);
+}
+
+// ------------------------------------------------------------------
+// Live stream (/api/events)
+// ------------------------------------------------------------------
+
+// Server-Sent Events: every new snapshot is serialized once into
+// eventFrame and queued to all subscribers as a "sample" event whose id is
+// the snapshot sequence. New subscribers get the current snapshot at once.
+#define EVENT_FRAME_SIZE 768
+
+AsyncEventSource events("/api/events");
+static char eventFrame[EVENT_FRAME_SIZE];
+static uint32_t eventSequence;      // last snapshot published
+
+// Serialize snap into buf; returns false if it did not fit
+static bool eventRender(const BatterySnapshot &snap, char *buf, size_t size) {
+    JsonWriter w(buf, size);
+    snapshotToJson(w, snap, false);
+    return !w.overflow();
+}
+
+void eventsPoll() {
+    if (snapshot.sequence == eventSequence) return;
+
+    BatterySnapshot snap;
+    snapshotGet(&snap);
+    eventSequence = snap.sequence;
+    if (!events.count()) return;
+
+    if (eventRender(snap, eventFrame, sizeof(eventFrame))) {
+        events.send(eventFrame, "sample", snap.sequence);
+    }
 }
 
-void handleApiLeds() {
-    bool state = server.hasArg("state") && server.arg("state") == "1";
+void eventsConnect(AsyncEventSourceClient *client) {
+    if (!snapshot.sequence) return;
 
-    setEnable(true);
-    delay(400);
+    // Runs on the async TCP task: render into a frame of our own so a
+    // publish from loop() cannot overwrite it
+    static char frame[EVENT_FRAME_SIZE];
+    BatterySnapshot snap;
+    snapshotGet(&snap);
+    if (eventRender(snap, frame, sizeof(frame))) {
+        client->send(frame, "sample", snap.sequence);
+    }
+}
+
+// ------------------------------------------------------------------
+// Prometheus exposition (/metrics)
+// ------------------------------------------------------------------
+
+// The exposition is produced in chunks by re-running the renderer and
+// keeping only the bytes that fall in the requested window, so a scrape
+// allocates nothing. The values are frozen when the scrape starts (the
+// offsets must not move between chunks), and only cached values are
+// exported: a scrape never queues a bus request.
+struct MetricsFrame {
+    BatterySnapshot snap;
+    BusMetrics bus;
+    FrameStats frames[FRAME_KINDS];
+    uint32_t readsExecuted[BUS_READ_TYPES];
+    uint32_t readsCoalesced[BUS_READ_TYPES];
+    uint32_t samplerReads;
+    uint32_t bridgeFrames;
+    uint32_t bridgeTimeouts;
+    uint32_t bridgeDiscarded;
+    uint32_t bridgeOverruns;
+    uint32_t bridgeSessionFrames;
+    uint32_t streamDropped;
+    uint32_t heapFree;
+    uint32_t heapMinFree;
+    uint32_t uptimeMs;
+};
+
+static MetricsFrame metricsFrame;
+static AsyncWebServerRequest *metricsOwner;     // scrape using metricsFrame
+
+static uint8_t *metricsOut;     // window being filled
+static size_t metricsSkip;      // window start in the whole text
+static size_t metricsMax;
+static size_t metricsPos;       // bytes rendered so far
+static size_t metricsLen;       // bytes copied into the window
+
+static void metricsPrintf(const char *fmt, ...) {
+    static char line[192];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(line)) n = sizeof(line) - 1;
+
+    // Copy the part of this line that overlaps [skip, skip + max)
+    size_t from = metricsPos < metricsSkip ? metricsSkip - metricsPos : 0;
+    if (from < (size_t)n && metricsLen < metricsMax) {
+        size_t len = n - from;
+        if (len > metricsMax - metricsLen) len = metricsMax - metricsLen;
+        memcpy(&metricsOut[metricsLen], &line[from], len);
+        metricsLen += len;
+    }
+    metricsPos += n;
+}
+
+static void metricsHeader(const char *name, const char *type, const char *help) {
+    metricsPrintf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void metricsGauge(const char *name, const char *help, float value) {
+    metricsHeader(name, "gauge", help);
+    metricsPrintf("%s %.3f\n", name, value);
+}
+
+static void metricsCounter(const char *name, const char *help, uint32_t value) {
+    metricsHeader(name, "counter", help);
+    metricsPrintf("%s %u\n", name, value);
+}
+
+static void metricsRender() {
+    const MetricsFrame &f = metricsFrame;
+    const BatterySnapshot &snap = f.snap;
+    const BatteryData &data = snap.data;
+
+    // Battery (sampler snapshot)
+    metricsGauge("obi_battery_valid", "1 if the last info read succeeded", data.valid ? 1 : 0);
+    metricsGauge("obi_battery_present", "1 if the last read saw a presence pulse", snap.present ? 1 : 0);
+    metricsGauge("obi_snapshot_age_seconds", "Time since the last full read",
+                 snap.sequence ? (f.uptimeMs - snap.takenMs) / 1000.0f : -1.0f);
+    metricsGauge("obi_pack_voltage_volts", "Pack voltage", data.packMv / 1000.0f);
+    metricsHeader("obi_cell_voltage_volts", "gauge", "Cell voltage");
+    for (int i = 0; i < 5; i++) {
+        metricsPrintf("obi_cell_voltage_volts{cell=\"%d\"} %.3f\n", i + 1, data.cellMv[i] / 1000.0f);
+    }
+    metricsGauge("obi_cell_diff_volts", "Highest minus lowest cell voltage", data.cellDiffMv / 1000.0f);
+    metricsHeader("obi_temperature_celsius", "gauge", "Thermistor temperature");
+    metricsPrintf("obi_temperature_celsius{sensor=\"cell\"} %.2f\n", data.tempCellCentiC / 100.0f);
+    metricsPrintf("obi_temperature_celsius{sensor=\"mosfet\"} %.2f\n", data.tempMosfetCentiC / 100.0f);
+    metricsGauge("obi_error_code", "BMS error code", data.errorCode);
+    metricsGauge("obi_charge_count", "Charge cycles", data.chargeCount);
+    metricsHeader("obi_bus_reads_total", "counter", "Read requests, run on the bus or coalesced into one in flight");
+    for (int t = 0; t < BUS_READ_TYPES; t++) {
+        metricsPrintf("obi_bus_reads_total{type=\"%s\",result=\"executed\"} %u\n", busReadName(t), f.readsExecuted[t]);
+        metricsPrintf("obi_bus_reads_total{type=\"%s\",result=\"coalesced\"} %u\n", busReadName(t), f.readsCoalesced[t]);
+    }
+    metricsCounter("obi_sampler_reads_total", "Full reads started by the background sampler", f.samplerReads);
+
+    // Bus
+    metricsCounter("obi_bus_resets_total", "Reset pulses sent by exchanges", f.bus.resets);
+    metricsCounter("obi_bus_no_presence_total", "Exchange resets nobody answered", f.bus.noPresence);
+    metricsCounter("obi_bus_power_cycles_total", "Enable power cycles", f.bus.powerCycles);
+    metricsCounter("obi_bus_retries_total", "Exchange retries", f.bus.retries);
+    metricsCounter("obi_wake_polls_total", "Presence polls while waking", f.bus.wakePolls);
+    metricsCounter("obi_wake_timeouts_total", "Wakes that gave up", f.bus.wakeTimeouts);
+
+    metricsHeader("obi_frames_total", "counter", "Frame validation outcomes");
+    for (int k = 0; k < FRAME_KINDS; k++) {
+        const FrameStats &fs = f.frames[k];
+        const char *kind = frameKindName(k);
+        metricsPrintf("obi_frames_total{kind=\"%s\",result=\"ok\"} %u\n", kind, fs.ok);
+        metricsPrintf("obi_frames_total{kind=\"%s\",result=\"failed\"} %u\n", kind, fs.failures);
+        metricsPrintf("obi_frames_total{kind=\"%s\",result=\"blank\"} %u\n", kind, fs.blank);
+        metricsPrintf("obi_frames_total{kind=\"%s\",result=\"rom_mismatch\"} %u\n", kind, fs.romMismatch);
+        metricsPrintf("obi_frames_total{kind=\"%s\",result=\"range\"} %u\n", kind, fs.range);
+        metricsPrintf("obi_frames_total{kind=\"%s\",result=\"bad_crc\"} %u\n", kind, fs.badCrc);
+        metricsPrintf("obi_frames_total{kind=\"%s\",result=\"no_ack\"} %u\n", kind, fs.noAck);
+    }
 
-    // Test mode command
-    byte cmd1[] = {0xD9, 0x96, 0xA5};
-    byte rsp[32];
-    cmdAndRead33(cmd1, 3, rsp, 9);
+    metricsHeader("obi_bus_exchange_seconds", "histogram", "Exchange latency including retries");
+    for (int op = 0; op < BUS_OPS; op++) {
+        const LatencyHistogram &h = f.bus.latency[op];
+        const char *name = busOpcodeName(op);
+        uint32_t cumulative = 0;
+        for (int b = 0; b < LATENCY_BUCKETS - 1; b++) {
+            cumulative += h.buckets[b];
+            metricsPrintf("obi_bus_exchange_seconds_bucket{op=\"%s\",le=\"%.3f\"} %u\n",
+                          name, latencyBoundsMs[b] / 1000.0f, cumulative);
+        }
+        metricsPrintf("obi_bus_exchange_seconds_bucket{op=\"%s\",le=\"+Inf\"} %u\n", name, h.count);
+        metricsPrintf("obi_bus_exchange_seconds_sum{op=\"%s\"} %.3f\n", name, h.totalMs / 1000.0f);
+        metricsPrintf("obi_bus_exchange_seconds_count{op=\"%s\"} %u\n", name, h.count);
+    }
 
-    // LED command
-    byte cmd2[] = {0xDA, (byte)(state ? 0x31 : 0x34)};
-    cmdAndRead33(cmd2, 2, rsp, 9);
+    // Serial bridge
+    metricsCounter("obi_bridge_frames_total", "Complete host frames", f.bridgeFrames);
+    metricsCounter("obi_bridge_timeouts_total", "Host frames dropped at their deadline", f.bridgeTimeouts);
+    metricsCounter("obi_bridge_discarded_bytes_total", "Bytes skipped while resynchronising", f.bridgeDiscarded);
+    metricsCounter("obi_bridge_overrun_bytes_total", "Bytes lost to a full receive ring", f.bridgeOverruns);
+    metricsCounter("obi_bridge_session_frames_total", "Bridge exchanges that kept the pack powered for the next frame",
+                   f.bridgeSessionFrames);
+    metricsCounter("obi_stream_dropped_total", "Telemetry records dropped on a full queue", f.streamDropped);
 
-    setEnable(false);
+    // System
+    metricsGauge("obi_heap_free_bytes", "Free heap", f.heapFree);
+    metricsGauge("obi_heap_min_free_bytes", "Lowest free heap since boot", f.heapMinFree);
+    metricsGauge("obi_uptime_seconds", "Time since boot", f.uptimeMs / 1000.0f);
 
-    server.send(200, "application/json", "{\"success\":true}");
 }
 
-void handleApiReset() {
-    setEnable(true);
-    delay(400);
+// Fills one chunk; returns 0 once the whole text has been sent
+static size_t metricsFill(uint8_t *buf, size_t maxLen, size_t index) {
+    metricsOut = buf;
+    metricsSkip = index;
+    metricsMax = maxLen;
+    metricsPos = 0;
+    metricsLen = 0;
+    metricsRender();
+    if (!metricsLen) metricsOwner = nullptr;
+    return metricsLen;
+}
 
-    // Test mode
-    byte cmd1[] = {0xD9, 0x96, 0xA5};
-    byte rsp[32];
-    cmdAndRead33(cmd1, 3, rsp, 9);
+void handleMetrics(AsyncWebServerRequest *request) {
+    if (metricsOwner) {
+        request->send(503, "text/plain", "scrape in progress\n");
+        return;
+    }
 
-    // Reset error
-    byte cmd2[] = {0xDA, 0x04};
-    cmdAndRead33(cmd2, 2, rsp, 9);
+    MetricsFrame &f = metricsFrame;
+    snapshotGet(&f.snap);
+    f.bus = busMetrics;
+    memcpy(f.frames, frameStats, sizeof(f.frames));
+    memcpy(f.readsExecuted, readsExecuted, sizeof(f.readsExecuted));
+    memcpy(f.readsCoalesced, readsCoalesced, sizeof(f.readsCoalesced));
+    f.samplerReads = samplerReads;
+    f.bridgeFrames = bridgeParser.frames;
+    f.bridgeTimeouts = bridgeParser.timeouts;
+    f.bridgeDiscarded = bridgeParser.discarded;
+    f.bridgeOverruns = bridgeParser.overruns;
+    f.bridgeSessionFrames = bridgeSessionFrames;
+    f.streamDropped = streamDropped;
+    f.heapFree = ESP.getFreeHeap();
+    f.heapMinFree = ESP.getMinFreeHeap();
+    f.uptimeMs = millis();
+
+    metricsOwner = request;
+    request->onDisconnect([request]() {
+        if (metricsOwner == request) metricsOwner = nullptr;
+    });
+    request->send(request->beginChunkedResponse("text/plain; version=0.0.4", metricsFill));
+}
 
-    setEnable(false);
+void replyTestMode(AsyncWebServerRequest *request, const WebJob *job) {
+    request->send(200, "application/json",
+                  job->bus.success ? "{\"success\":true}" : "{\"success\":false}");
+}
 
-    server.send(200, "application/json", "{\"success\":true}");
+void handleApiLeds(AsyncWebServerRequest *request) {
+    bool state = request->hasArg("state") && request->arg("state") == "1";
+    webBusRequest(request, BUS_REQ_TEST_MODE, state ? 0x31 : 0x34, replyTestMode);
+}
+
+void handleApiReset(AsyncWebServerRequest *request) {
+    webBusRequest(request, BUS_REQ_TEST_MODE, 0x04, replyTestMode);
 }
 
 void setupWebServer() {
     server.on("/", HTTP_GET, handleRoot);
     server.on("/api/read", HTTP_GET, handleApiRead);
     server.on("/api/voltages", HTTP_GET, handleApiVoltages);
+    server.on("/api/wake", HTTP_GET, handleApiWake);
+    server.on("/api/frames", HTTP_GET, handleApiFrames);
+    server.on("/api/metrics", HTTP_GET, handleApiMetrics);
+    server.on("/metrics", HTTP_GET, handleMetrics);
     server.on("/api/leds", HTTP_GET, handleApiLeds);
     server.on("/api/reset", HTTP_GET, handleApiReset);
 
+    events.onConnect(eventsConnect);
+    server.addHandler(&events);
+
     server.begin();
     Serial.println("Web server started on port 80");
 }
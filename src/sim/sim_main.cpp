@@ -0,0 +1,106 @@
+/**
+ * OBI ESP32 - host simulation
+ *
+ * Runs the battery protocol code (battery.cpp) against the Makita slave
+ * emulator on a simulated wire, entirely on Linux:
+ *
+ *   pio run -e native && .pio/build/native/program [reads]
+ *
+ * The emulator runs on its own thread as the second party on the
+ * open-drain line (see OneWireHalHost.h). Each read opens an enable window,
+ * runs the batched info/model/voltage read and prints the decoded data and
+ * per-stage timing, so protocol changes can be checked without hardware.
+ * A read fails unless the ROM ID, model and cell voltages match what the
+ * emulator was configured with and it needed no power cycle and saw every
+ * presence pulse; the exit status is non-zero if any read failed.
+ * Simulated time runs SIMWIRE_SLOWDOWN times slower than wall time; the
+ * printed timings are simulated milliseconds.
+ */
+
+#include <atomic>
+#include <thread>
+#include "Makita.h"
+#include "battery.h"
+
+static std::atomic<bool> running(true);
+
+// What the emulator is configured with, and what every read must return
+static const uint8_t simRomId[8] = {0x16, 0x07, 0x13, 0x64, 0x14, 0x0A, 0x0E, 0x70};
+static const uint8_t simModel[16] = {0x1A, 0x01, 0x0A, 0x00, 0x02, 0x03, 0x00, 0x08,
+                                     0x24, 0x19, 0x2A, 0x3D, 0x05, 0x00, 0x00, 0x00};
+static const float simCells[5] = {3.91f, 3.92f, 3.90f, 3.93f, 3.91f};
+
+static void batteryThread() {
+    simwire_set_party(1);
+
+    Makita<ONEWIRE_PIN> battery;
+    battery.set_extended(true);
+    battery.set_rom_id(simRomId);
+    battery.set_model(simModel);
+    for (int i = 0; i < 5; i++) {
+        battery.set_cell_voltage(i, simCells[i]);
+    }
+
+    while (running) {
+        battery.rom_command();
+    }
+}
+
+int main(int argc, char **argv) {
+    int reads = argc > 1 ? atoi(argv[1]) : 3;
+    int ok = 0;
+
+    std::thread slave(batteryThread);
+
+    for (int i = 0; i < reads; i++) {
+        ReadTiming timing = {};
+        uint32_t start = millis();
+
+        uint32_t noPresence = busMetrics.noPresence;
+
+        beginSession();
+        timing.settleMs = sessionSettleMs;
+        bool success = sessionReadAll(&timing);
+        endSession();
+        timing.totalMs = millis() - start;
+
+        noPresence = busMetrics.noPresence - noPresence;
+
+        // The model as readModelModern() stores it: 7 bytes, NUL terminated
+        char model[8];
+        memcpy(model, simModel, 7);
+        model[7] = '\0';
+
+        const char *problem = nullptr;
+        if (!success) problem = "info read failed";
+        else if (memcmp(batteryData.romId, simRomId, 8) != 0) problem = "ROM ID mismatch";
+        else if (strcmp(batteryData.model, model) != 0) problem = "model mismatch";
+        else if (noPresence) problem = "missed presence";
+        else if (timing.powerCycles) problem = "power cycled";
+        for (int c = 0; c < 5 && !problem; c++) {
+            if (batteryData.cellMv[c] != (uint16_t)(simCells[c] * 1000.0f)) problem = "cell mismatch";
+        }
+
+        if (!problem) ok++;
+
+        printf("read %d: %s rom=%02X%02X%02X%02X%02X%02X%02X%02X pack=%umV cells=%u/%u/%u/%u/%u\n",
+               i + 1, problem ? "FAILED" : "ok",
+               batteryData.romId[0], batteryData.romId[1], batteryData.romId[2], batteryData.romId[3],
+               batteryData.romId[4], batteryData.romId[5], batteryData.romId[6], batteryData.romId[7],
+               batteryData.packMv,
+               batteryData.cellMv[0], batteryData.cellMv[1],
+               batteryData.cellMv[2], batteryData.cellMv[3],
+               batteryData.cellMv[4]);
+        printf("  timing ms: settle=%u info=%u model=%u voltages=%u total=%u\n",
+               timing.settleMs, timing.infoMs, timing.modelMs,
+               timing.voltagesMs, timing.totalMs);
+        printf("  power cycles=%u missed presence=%u\n", timing.powerCycles, noPresence);
+        if (problem) printf("  %s\n", problem);
+    }
+
+    running = false;
+    slave.join();
+
+    printf("%d/%d reads ok\n", ok, reads);
+    return ok == reads ? 0 : 1;
+}
@@ -4,7 +4,10 @@
  * FUNCTIONAL REQUIREMENTS:
  * 1. Serve single-page web application for battery diagnostics
  * 2. Provide REST API endpoints for battery operations
- * 3. Display real-time battery status via AJAX polling
+ * 3. Display real-time battery status pushed over Server-Sent Events
+ *
+ * scripts/build_web.py minifies and gzips INDEX_HTML into
+ * web_interface_gz.h at build time; edit the page here.
  *
  * AI-generated on 2025-12-16
  */
@@ -260,32 +263,36 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
             }
         }
 
+        function showBattery(data) {
+            document.getElementById('model').textContent = data.model || '--';
+            document.getElementById('status').textContent = data.locked ? 'LOCKED' : 'OK';
+            document.getElementById('chargeCount').textContent = data.chargeCount || '--';
+            document.getElementById('mfgDate').textContent = data.mfgDate || '--';
+            document.getElementById('capacity').textContent = data.capacity ? data.capacity + ' Ah' : '--';
+            document.getElementById('errorCode').textContent = data.errorCode;
+            document.getElementById('packVoltage').textContent = data.packVoltage.toFixed(2) + ' V';
+
+            for (let i = 1; i <= 5; i++) {
+                const el = document.getElementById('cell' + i);
+                const v = data['cell' + i];
+                el.textContent = v.toFixed(3) + ' V';
+                setCellClass(el, v);
+            }
+
+            document.getElementById('cellDiff').textContent = data.cellDiff.toFixed(3) + ' V';
+            document.getElementById('tempCell').textContent = data.tempCell.toFixed(1) + ' °C';
+            document.getElementById('tempMosfet').textContent = data.tempMosfet ? data.tempMosfet.toFixed(1) + ' °C' : '--';
+
+            setStatus('Battery connected: ' + (data.model || 'Unknown'), 'ok');
+        }
+
         async function readBattery() {
             setStatus('Reading battery...', 'waiting');
             log('Reading battery info...');
 
-            const data = await apiCall('read');
+            const data = await apiCall('read?fresh=1');
             if (data && data.success) {
-                document.getElementById('model').textContent = data.model || '--';
-                document.getElementById('status').textContent = data.locked ? 'LOCKED' : 'OK';
-                document.getElementById('chargeCount').textContent = data.chargeCount || '--';
-                document.getElementById('mfgDate').textContent = data.mfgDate || '--';
-                document.getElementById('capacity').textContent = data.capacity ? data.capacity + ' Ah' : '--';
-                document.getElementById('errorCode').textContent = data.errorCode;
-                document.getElementById('packVoltage').textContent = data.packVoltage.toFixed(2) + ' V';
-
-                for (let i = 1; i <= 5; i++) {
-                    const el = document.getElementById('cell' + i);
-                    const v = data['cell' + i];
-                    el.textContent = v.toFixed(3) + ' V';
-                    setCellClass(el, v);
-                }
-
-                document.getElementById('cellDiff').textContent = data.cellDiff.toFixed(3) + ' V';
-                document.getElementById('tempCell').textContent = data.tempCell.toFixed(1) + ' °C';
-                document.getElementById('tempMosfet').textContent = data.tempMosfet ? data.tempMosfet.toFixed(1) + ' °C' : '--';
-
-                setStatus('Battery connected: ' + (data.model || 'Unknown'), 'ok');
+                showBattery(data);
                 log('Battery read successful: ' + data.model);
             } else {
                 setStatus('Failed to read battery', 'error');
@@ -296,7 +303,7 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
         async function readVoltages() {
             log('Reading voltages...');
 
-            const data = await apiCall('voltages');
+            const data = await apiCall('voltages?fresh=1');
             if (data && data.success) {
                 document.getElementById('packVoltage').textContent = data.packVoltage.toFixed(2) + ' V';
 
@@ -334,8 +341,25 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
             }
         }
 
+        // Live updates: the firmware pushes every new sample, so the page
+        // never polls. EventSource reconnects by itself after a drop.
+        function startLive() {
+            const source = new EventSource('/api/events');
+            source.addEventListener('sample', (e) => {
+                const data = JSON.parse(e.data);
+                if (data.success) {
+                    showBattery(data);
+                } else {
+                    setStatus(data.present ? 'Battery not responding' : 'No battery connected', 'waiting');
+                }
+            });
+            source.onopen = () => log('Live updates connected');
+            source.onerror = () => setStatus('Live updates disconnected, retrying...', 'error');
+        }
+
         // Initial status check
         log('Checking connection...');
+        startLive();
     </script>
 </body>
 </html>